@@ -4,31 +4,92 @@
 #include <esp_now.h>
 #include <WiFi.h>
 #include <functional>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+#include "SpscRing.h"
+#include "EspNowTx.h"
+#include "PnowProtocol.h"
+#include "PreferenceService.h"
+
+// Peer table capacity (override with -D ESPNOW_MAX_PEERS=<n> in build_flags)
+#ifndef ESPNOW_MAX_PEERS
+#define ESPNOW_MAX_PEERS 64
+#endif
+
+// smallest power of 2 >= n (sizes the peer hash index)
+constexpr uint16_t espnowPow2AtLeast(uint16_t n)
+{
+  return n <= 1 ? 1 : (uint16_t)(espnowPow2AtLeast((uint16_t)((n + 1) / 2)) * 2);
+}
 
 // EspNowService
-// - Maintains a peer table (from topology/result: mac + lmk + deviceKey)
-// - Supports ONE in-flight request at a time (sequential polling)
-// - Provides a FIFO queue for requests arriving while one is in-flight
-// - Request/response matched by correlationId (16 bytes)
-// - Optional LMK encryption per peer (AES-128 as per ESP-NOW)
+// - Peer table from topology/result (mac + lmk + deviceKey): fixed POD records + MAC hash index
+// - pnow requests (see PnowProtocol.h) matched by peer MAC + seq: up to MAX_INFLIGHT in flight,
+//   one per peer, the rest queued by priority class (control > interactive > polls, with aging);
+//   duplicate STATUS/TELEMETRY requests share one exchange, callers may give a deadline
+// - Per peer: adaptive RTO, circuit breaker, link counters, seqs increasing across reboots
+// - Passive liveness and telemetry pushes from probe frames (presence edges, push callback);
+//   probes that lost the gateway find it with EVT_PING and are told when its channel moves
+// - Optional background poller keeps a telemetry snapshot per peer for cache-first reads
+// - Radio driver peer slots (few, fewer encrypted) are an LRU cache over the peer table.
+//   Frames from an encrypted peer only decrypt while it has one, so peers that beacon are kept
+//   resident (up to DRIVER_RESIDENT_MAX); a silent peer that isn't is polled before it is
+//   reported offline (larger fleets: presence of the rest rests on those polls)
+//
+// Threading: the WiFi callbacks only copy into SPSC rings, an engine task does the work, and
+// request callbacks run from loop() on the caller's task (public methods are safe from it).
 
 class EspNowService
 {
 public:
-  static constexpr uint8_t MAX_PEERS = 64;
+  static constexpr uint16_t MAX_PEERS = ESPNOW_MAX_PEERS;
   static constexpr uint8_t MAX_QUEUE = 8;
+  static constexpr uint8_t MAX_INFLIGHT = 8;
+
+  // engine task (WiFi runs on core 0 too; the Arduino loop and its blocking MQTT/TLS on core 1)
+  static constexpr BaseType_t TASK_CORE = 0;
+  static constexpr UBaseType_t TASK_PRIO = 5;
+  static constexpr uint32_t TASK_STACK = 4096;
+
+  static constexpr uint8_t DEVICE_KEY_MAX = 48; // incl. '\0'
+
+  // seqs reserved per NVS write (the ceiling is persisted before any seq above it is sent)
+  static constexpr uint32_t SEQ_RESERVE = 1024;
+
+  // RTT histogram buckets per peer (limits: rttBucketLimitMs)
+  static constexpr uint8_t RTT_BUCKETS = 8;
+
+  enum class Error : uint8_t
+  {
+    None = 0,
+    Timeout,    // no answer after all retries
+    Rejected,   // probe answered ok=0 (see probeErr)
+    NoData,     // probe answered but had no reading
+    SendFailed, // frame could not be handed to the radio
+    DeadlineExceeded, // caller's deadline passed before an answer
+    ProbeOffline,     // circuit breaker open: not sent
+    PeerRemoved,      // peer dropped from the table (topology) before an answer
+  };
 
   struct Peer
   {
     uint8_t mac[6]{};
     uint8_t lmk[16]{};
     bool hasLmk = false;
-    String deviceKey;
+    char deviceKey[DEVICE_KEY_MAX]{};
+
+    // truncates to DEVICE_KEY_MAX - 1 chars
+    void setDeviceKey(const String &key);
   };
 
   struct TelemetryResponse
   {
     bool ok = false;
+    Error error = Error::None;
     int32_t weight = 0;
     uint16_t variance = 0;
     uint32_t tagAtMs = 0;
@@ -36,64 +97,447 @@ public:
     String uid;
   };
 
+  struct CommandResponse
+  {
+    bool ok = false;
+    Error error = Error::None;
+    uint8_t probeErr = 0; // pnow::ErrCode when error == Rejected
+    uint32_t arg = 0;     // AckPayload.arg (e.g. reset nonce)
+
+    // CMD_STATUS only
+    bool hasStatus = false;
+    uint32_t uptimeS = 0;
+    int32_t lastWeight = 0;
+    uint8_t statusFlags = 0;
+  };
+
+  struct LinkStats
+  {
+    uint32_t requests = 0;  // requests sent (a coalesced one counts once)
+    uint32_t responses = 0; // replies matched to a request
+    uint32_t timeouts = 0;  // requests failed after all retries
+    uint32_t retries = 0;   // resends after a response timeout
+    uint32_t delivered = 0; // frames ACKed at MAC level
+    uint32_t failed = 0;    // frames lost after all MAC-level resends
+    uint16_t rttHist[RTT_BUCKETS]{}; // Karn-clean samples, saturating
+
+    // filled by getLinkStats
+    uint32_t srttMs = 0; // 0 = no sample yet
+    int8_t rssiLast = 0; // dBm, 0 = unknown
+    int8_t rssiAvg = 0;
+  };
+
+  struct Liveness
+  {
+    bool online = false;
+    uint32_t lastSeenAgoMs = 0; // valid once seen
+    bool seen = false;
+    int8_t rssi = 0;            // last frame, dBm (0 = unknown)
+    uint32_t heartbeats = 0;
+    uint32_t lastGapMs = 0;     // between the last two heartbeats
+    uint32_t maxGapMs = 0;
+  };
+
   using TelemetryCallback = std::function<void(const TelemetryResponse &)>;
+  using CommandCallback = std::function<void(const CommandResponse &)>;
+  using PresenceCallback = std::function<void(const uint8_t mac[6], bool online, int8_t rssi)>;
+  using PushCallback = std::function<void(const uint8_t mac[6], const TelemetryResponse &)>;
 
-  EspNowService();
+  explicit EspNowService(PreferenceService &prefs);
 
   bool begin();
+  // Runs completed request callbacks (call from the task that owns MQTT).
   void loop();
 
-  void upsertPeer(const Peer &p);
-  uint8_t peerCount() const { return _peerCount; }
+  // false if the table is full (update of a known MAC always succeeds)
+  bool upsertPeer(const Peer &p);
+  bool removePeer(const uint8_t mac[6]);
+  uint16_t peerCount() const { return _peerCount; }
+
+  // O(1) lookup, nullptr if unknown. Pointers are invalidated by upsert/remove.
+  const Peer *findPeer(const uint8_t mac[6]) const;
+  const Peer *peerAt(uint16_t i) const { return i < _peerCount ? &_peers[i] : nullptr; }
+
+  // Static RAM cost of the peer table (records + runtime state + hash index)
+  static constexpr size_t peerTableBytes()
+  {
+    return (sizeof(Peer) + sizeof(PeerState)) * MAX_PEERS + sizeof(uint16_t) * INDEX_SIZE;
+  }
 
-  // correlationIdHex must be 32 hex chars.
+  // Bounds for the per-peer retransmission timeout.
+  void setRtoBounds(uint32_t minMs, uint32_t maxMs);
+
+  // RSSI of received frames via promiscuous mode (off by default: every management frame on the
+  // channel then wakes the WiFi task). Off: RSSI reads 0 (unknown).
+  bool setRssiSniffer(bool enable);
+
+  // Circuit breaker: open after threshold consecutive timeouts (0 = off), trial after openMs.
+  void setBreaker(uint8_t threshold, uint32_t openMs);
+
+  // Presence edges (run from loop()); a peer is offline after offlineAfterMs without a frame.
+  void setPresenceCallback(PresenceCallback cb, uint32_t offlineAfterMs);
+  bool getLiveness(const uint8_t mac[6], Liveness &out) const;
+
+  // Changed readings pushed by probes (run from loop()).
+  void setPushCallback(PushCallback cb);
+
+  // Background poller: one peer every intervalMs (0 = off). Polls only use spare queue slots.
+  // sweepMs > 0: the tick shrinks with the table so every peer is visited within sweepMs
+  // (never below POLL_MIN_TICK_MS).
+  void setPollInterval(uint32_t intervalMs, uint32_t timeoutMs = 1200, uint8_t retries = 0, uint32_t sweepMs = 0);
+
+  // Link counters of a known peer, false if unknown.
+  bool getLinkStats(const uint8_t mac[6], LinkStats &out) const;
+  // upper bound (inclusive) of RTT bucket i, UINT32_MAX for the last one
+  static uint32_t rttBucketLimitMs(uint8_t i);
+  EspNowTx::Stats txStats() const { return _tx.stats(); }
+
+  // radio driver peer slots in use / LRU evictions since boot
+  uint8_t driverPeerCount() const;
+  uint32_t driverEvictions() const { return _driverEvictions; }
+
+  // Latest successful TelemetryResponse of a peer (from polls or any request), false if none yet.
+  bool getSnapshot(const uint8_t mac[6], TelemetryResponse &out, uint32_t &ageMs) const;
+
+  // CMD_TELEMETRY -> RSP_TELEMETRY. false if the queue is full.
+  // deadlineMs: budget from now (0 = none) after which cb gets DeadlineExceeded.
   bool requestTelemetryByMac(const uint8_t mac[6],
-                             const String &correlationIdHex,
                              TelemetryCallback cb,
                              uint32_t timeoutMs = 1200,
-                             uint8_t retries = 1);
+                             uint8_t retries = 1,
+                             uint32_t deadlineMs = 0);
+
+  // Any other command (CMD_STATUS answers with RSP_STATUS, the rest with RSP_ACK).
+  // CMD_RESET runs both steps (arm + confirm with the same nonce) before the callback;
+  // its payload may be empty, a random nonce is used then.
+  bool sendCommand(const uint8_t mac[6],
+                   pnow::MsgType cmd,
+                   const uint8_t *payload,
+                   uint16_t len,
+                   CommandCallback cb,
+                   uint32_t timeoutMs = 1200,
+                   uint8_t retries = 1,
+                   uint32_t deadlineMs = 0);
 
   static bool parseMac(const String &s, uint8_t out[6]);
+  static String macToString(const uint8_t mac[6]); // "AA:BB:CC:DD:EE:FF"
   static bool hexTo16(const String &hex, uint8_t out[16]);
+  static const char *errorName(Error e);           // "timeout", "rejected", ...
+  static const char *probeErrName(uint8_t err);    // pnow::ErrCode -> "replay", ...
 
 private:
+  // one internal callback type for both request kinds (the public ones are wrapped)
+  struct Reply
+  {
+    TelemetryResponse tel;
+    CommandResponse cmd;
+  };
+  using ReplyCallback = std::function<void(const Reply &)>;
+
+  // one caller waiting on a request; lists are linked through a fixed pool (_waiters)
+  struct Waiter
+  {
+    bool used = false;
+    ReplyCallback cb;
+    bool hasDeadline = false;
+    uint32_t deadlineMs = 0;
+    int8_t next = -1;
+  };
+
+  enum Priority : uint8_t
+  {
+    PRIO_CONTROL = 0,
+    PRIO_INTERACTIVE = 1,
+    PRIO_BACKGROUND = 2,
+  };
+
+  // a queued request moves up one class per PRIO_AGING_MS (ordering only)
+  static constexpr uint32_t PRIO_AGING_MS = 2000;
+  // in-flight slots a poll never takes, whatever its age
+  static constexpr uint8_t INFLIGHT_RESERVED = 2;
+
   struct QueueItem
   {
     bool used = false;
+    uint8_t prio = PRIO_BACKGROUND;
+    uint32_t enqueuedAtMs = 0;
     uint8_t mac[6]{};
-    uint8_t corr[16]{};
-    TelemetryCallback cb;
+    uint8_t type = 0; // pnow::MsgType
+    uint16_t len = 0;
+    uint8_t payload[pnow::PN_MAX_PAYLOAD]{};
+    int8_t waiters = -1; // -1 = none (background poll)
     uint32_t timeoutMs = 1200;
     uint8_t retries = 1;
   };
 
+  enum : uint8_t
+  {
+    BREAKER_CLOSED = 0,
+    BREAKER_OPEN,
+    BREAKER_HALF_OPEN,
+  };
+
+  // runtime state kept next to each Peer record (same index)
+  struct PeerState
+  {
+    bool hasSnapshot = false;
+    uint32_t snapshotAtMs = 0;
+    int32_t weight = 0;
+    uint16_t variance = 0;
+    uint32_t tagAtMs = 0;
+    uint32_t weightAtMs = 0;
+    char uid[17]{};
+
+    // telemetry push
+    bool pushes = false; // has pushed this boot
+    uint32_t pushSeq = 0;
+    uint8_t pushChanges = 0;
+
+    // RTT estimator (RFC 6298 fixed point: srtt in 1/8 ms, rttvar in 1/4 ms)
+    bool hasRtt = false;
+    uint32_t srtt8 = 0;
+    uint32_t rttvar4 = 0;
+    uint8_t backoff = 0; // RTO doublings since the last valid sample
+
+    uint32_t txSeq = 0; // last seq sent to this peer (0 = none this boot)
+    LinkStats link;
+
+    // circuit breaker
+    uint8_t breaker = BREAKER_CLOSED;
+    uint8_t timeouts = 0; // consecutive
+    uint32_t breakerOpenedMs = 0;
+
+    // passive liveness
+    bool seen = false;
+    bool online = false;
+    int8_t rssi = 0;
+    int16_t rssiAvg8 = 0; // EWMA (1/8), x8; 0 = no sample
+    uint32_t lastSeenMs = 0;
+    uint32_t lastHbMs = 0;
+    uint32_t heartbeats = 0;
+    uint32_t lastGapMs = 0;
+    uint32_t maxGapMs = 0;
+
+    bool announceChannel = false; // CMD_CHANNEL due when next heard from
+    bool confirming = false;      // silent, but we couldn't have heard it: a poll decides
+  };
+
   struct Pending
   {
     bool active = false;
     uint8_t mac[6]{};
-    uint8_t corr[16]{};
-    TelemetryCallback cb;
-    uint32_t timeoutMs = 1200;
+    uint8_t type = 0;
+    uint16_t len = 0;
+    uint8_t payload[pnow::PN_MAX_PAYLOAD]{};
+    uint32_t firstSeq = 0; // seqs [firstSeq, seq] belong to the current step of this request
+    uint32_t seq = 0;      // seq of the last frame sent
+    int8_t waiters = -1;
+    uint32_t timeoutMs = 1200; // current RTO (doubles on each retry)
     uint32_t deadlineMs = 0;
+    uint32_t sentAtMs = 0;
+    bool retransmitted = false; // seq sent more than once (Karn: no RTT sample)
+    uint8_t retries = 1;        // budget per step (reset confirm gets a fresh one)
     uint8_t retriesLeft = 1;
+    bool holdSend = false;      // next send is due at deadlineMs (probe rate limit / reset step 2)
+    uint8_t resetStep = 0;      // CMD_RESET: 0 = arming, 1 = confirming
+    bool resynced = false;      // seq already moved above the probe's replay floor once
   };
 
+  struct RxFrame
+  {
+    uint8_t mac[6];
+    int8_t rssi; // 0 = not sniffed
+    uint8_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+  };
+
+  struct Completion
+  {
+    ReplyCallback cb;
+    Reply r;
+  };
+
+  struct PresenceEvent
+  {
+    uint8_t mac[6];
+    bool online;
+    int8_t rssi;
+  };
+
+  struct PushEvent
+  {
+    uint8_t mac[6];
+    TelemetryResponse r;
+  };
+
+  static constexpr uint16_t RX_RING_SIZE = 16;
+  static constexpr uint16_t PUSH_RING_SIZE = 8;
+  // a push seq this far behind the last one is a replay/duplicate, not a rebooted probe
+  static constexpr uint32_t PUSH_SEQ_WINDOW = 64;
+  static constexpr uint16_t PRESENCE_RING_SIZE = 16;
+  // wait before resending after ERR_RATE_LIMIT / ERR_BUSY when the probe gives no hint (older
+  // firmware), and before the reset confirm
+  static constexpr uint32_t PROBE_CMD_SPACING_MS = 250;
+  static constexpr uint32_t PROBE_MAX_HOLD_MS = 5000;
+  // how often loop() looks at the radio's channel
+  static constexpr uint32_t CHANNEL_CHECK_MS = 1000;
+  // fastest poll tick a sweep may ask for
+  static constexpr uint32_t POLL_MIN_TICK_MS = 100;
+  // callbacks are capped at this size (_cbOutstanding), so neither the ring nor the pool overflows
+  static constexpr uint16_t DONE_RING_SIZE = espnowPow2AtLeast(MAX_QUEUE + MAX_INFLIGHT);
+  static constexpr uint8_t MAX_WAITERS = DONE_RING_SIZE;
+
+  static void sniffStatic(void *buf, wifi_promiscuous_pkt_type_t type);
   static void recvStatic(const uint8_t *mac, const uint8_t *data, int len);
   void onRecv(const uint8_t *mac, const uint8_t *data, int len);
+  static void txResultStatic(void *ctx, const uint8_t mac[6], bool delivered);
+  void onTxResult(const uint8_t mac[6], bool delivered);
+  void onResponse(uint8_t slot, const pnow::Header &h, const uint8_t *payload);
+  void onPush(const uint8_t mac[6], const pnow::Header &h, const uint8_t *payload);
+  void answerPing(const uint8_t mac[6], uint32_t seq);
+  void announceChannelTo(const uint8_t mac[6]);
+  void checkChannel();
+  static void fromPayload(const pnow::TelemetryPayload &t, TelemetryResponse &out);
 
+  // engine task (all below run with _mtx held)
+  static void taskStatic(void *arg);
+  static void timerStatic(void *arg);
+  void taskLoop();
+  void serviceDeadlines(uint32_t nowMs);
+  uint32_t msUntilNextDeadline(uint32_t nowMs) const;
+  void wakeEngine();
+
+  bool enqueueLocked(const uint8_t mac[6], uint8_t type, const uint8_t *payload, uint16_t len,
+                     ReplyCallback cb, uint32_t timeoutMs, uint8_t retries, uint32_t deadlineMs);
+  void addWaiter(int8_t &head, ReplyCallback &&cb, uint32_t deadlineMs);
+  void completeWaiters(int8_t &head, const Reply &r);
+  // answers expired waiters DeadlineExceeded; true if the list had waiters and none is left
+  bool expireWaiters(int8_t &head, uint32_t nowMs);
   void processQueue();
-  void failPending();
-  bool sendReq(const uint8_t mac[6]);
+  void completePending(uint8_t slot, const Reply &r);
+  void failPending(uint8_t slot, Error e, uint8_t probeErr = 0);
+  bool sendReq(Pending &p, bool newSeq);
+  uint32_t nextSeq(const uint8_t mac[6]);
+  static bool isIdempotent(uint8_t type);
 
-  bool addPeerIfNeeded(const uint8_t mac[6]);
-  bool findPeer(const uint8_t mac[6], Peer &out);
+  bool isMacInFlight(const uint8_t mac[6]) const;
+  bool isMacQueued(const uint8_t mac[6]) const;
+  int8_t findFreeInFlight() const;
+  uint8_t freeInFlightSlots() const;
+  static Priority priorityOf(uint8_t type, bool hasCaller);
+  static uint8_t effectivePriority(const QueueItem &q, uint32_t nowMs);
+  uint8_t freeQueueSlots() const;
+
+  uint32_t rtoFor(const uint8_t mac[6], uint32_t initialMs) const;
+  void sampleRtt(const uint8_t mac[6], uint32_t rttMs);
+  void backoffRto(const uint8_t mac[6]);
+  // next seq to this peer goes above seq (probe rejected ours as a replay)
+  void resyncSeq(const uint8_t mac[6], uint32_t seq);
+
+  // false: answer ProbeOffline instead of sending (may move an open breaker to half-open)
+  bool breakerAdmits(const uint8_t mac[6], uint32_t nowMs);
+  void breakerRecord(const uint8_t mac[6], Error e);
+  void failQueued(const uint8_t mac[6], Error e);
+
+  // nullptr if unknown
+  LinkStats *linkOf(const uint8_t mac[6]);
+
+  void noteSeen(const uint8_t mac[6], int8_t rssi, bool heartbeat, uint32_t nowMs);
+  void serviceLiveness(uint32_t nowMs);
+  void goOffline(uint16_t rec);
+  // its frames reach us for sure: unencrypted, or encrypted with a resident driver slot
+  bool canHear(uint16_t rec) const;
+
+  void pollNextPeer();
+  // current poll tick (0 = off)
+  uint32_t pollTickMs() const;
+  void storeSnapshot(const uint8_t mac[6], const TelemetryResponse &r);
+
+  // radio driver peer slots (LRU)
+  static constexpr uint8_t DRIVER_SLOTS = ESP_NOW_MAX_TOTAL_PEER_NUM;
+  static constexpr uint8_t DRIVER_ENCRYPT_SLOTS = ESP_NOW_MAX_ENCRYPT_PEER_NUM;
+  // encrypted slots beaconing peers may keep; at least one rotates, so any peer can be asked
+  static constexpr uint8_t DRIVER_RESIDENT_MAX = DRIVER_ENCRYPT_SLOTS > 1 ? DRIVER_ENCRYPT_SLOTS - 1 : 0;
+
+  struct DriverSlot
+  {
+    bool used = false;
+    uint8_t mac[6]{};
+    bool encrypted = false;
+    uint8_t txQueued = 0; // frames in EspNowTx (pins the slot)
+    uint32_t lastUse = 0; // _driverTick at last use
+    bool stale = false;   // no longer matches the peer record: released once unpinned
+    bool resident = false; // kept for a beaconing peer (never the LRU victim) until it goes offline
+  };
+
+  int8_t findDriverSlot(const uint8_t mac[6]) const;
+  bool acquireDriverSlot(const uint8_t mac[6]);
+  bool canAcquireDriverSlot(const uint8_t mac[6]) const;
+  int8_t lruVictim(bool encryptedOnly) const;
+  void releaseDriverSlot(int8_t i);
+  // a queued frame or a request in flight (its reply must still decrypt)
+  bool driverPinned(int8_t i) const;
+  void releaseStaleDriverSlots();
+  void keepResident(const uint8_t mac[6]);
+
+  // hash index: linear probing, slot = record index + 1 (0 = empty)
+  static constexpr uint16_t INDEX_SIZE = espnowPow2AtLeast(MAX_PEERS * 2); // load <= 0.5
+  static constexpr uint16_t INDEX_MASK = INDEX_SIZE - 1;
+
+  static uint16_t hashMac(const uint8_t mac[6]);
+  int32_t findIndexSlot(const uint8_t mac[6]) const;
 
-private:
   Peer _peers[MAX_PEERS];
-  uint8_t _peerCount = 0;
+  PeerState _state[MAX_PEERS];
+  uint16_t _index[INDEX_SIZE]{};
+  uint16_t _peerCount = 0;
 
   QueueItem _queue[MAX_QUEUE];
-  Pending _pending;
+  Pending _inflight[MAX_INFLIGHT];
+  Waiter _waiters[MAX_WAITERS];
+
+  uint32_t _rtoMinMs = 30;
+  uint32_t _rtoMaxMs = 4000;
+
+  uint8_t _breakerThreshold = 3;
+  uint32_t _breakerOpenMs = 10000;
+
+  uint32_t _offlineAfterMs = 0; // 0 = liveness edges off
+  PresenceCallback _presenceCb;
+  PushCallback _pushCb;
+
+  uint32_t _pollIntervalMs = 0;
+  uint32_t _pollSweepMs = 0;
+  uint32_t _pollTimeoutMs = 1200;
+  uint8_t _pollRetries = 0;
+  uint32_t _lastPollMs = 0;
+  uint16_t _pollCursor = 0;
+
+  uint8_t _channel = 0; // AP's primary channel once associated, 0 = not yet
+  uint32_t _lastChannelCheckMs = 0;
+
+  DriverSlot _driver[DRIVER_SLOTS];
+  uint32_t _driverTick = 0;
+  uint32_t _driverEvictions = 0;
+
+  SpscRing<RxFrame, RX_RING_SIZE> _rx;
+  SpscRing<Completion, DONE_RING_SIZE> _done;
+  SpscRing<PresenceEvent, PRESENCE_RING_SIZE> _presence;
+  SpscRing<PushEvent, PUSH_RING_SIZE> _pushes;
+
+  // WiFi task only: RSSI of the last ESP-NOW frame seen by the sniffer (just before recvStatic)
+  uint8_t _sniffMac[6]{};
+  int8_t _sniffRssi = 0;
+  uint16_t _cbOutstanding = 0; // waiters in use + callbacks waiting in _done
+
+  PreferenceService &_prefs;
+  EspNowTx _tx;
+  uint32_t _seqHigh = 0;    // highest seq sent this boot (new peers continue from here)
+  uint32_t _seqCeiling = 0; // persisted: every seq ever sent is <= this
+
+  SemaphoreHandle_t _mtx = nullptr;
+  TaskHandle_t _task = nullptr;
+  esp_timer_handle_t _timer = nullptr;
 
   static EspNowService *_self;
 };
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// EspNowTx
+// - Send queue shared by gateway and probe: one frame on air at a time, the next one is handed
+//   to the driver only after the send callback reported the previous one (no ESP_ERR_ESPNOW_NO_MEM
+//   on bursts)
+// - A frame the MAC layer could not deliver (no 802.11 ACK) is resent right away, up to
+//   MAC_RETRIES times, instead of waiting for the application timeout
+// - Delivery results are counted and reported per frame through an optional hook
+//
+// Threading:
+// - send() is safe from any task (copies the frame under a mutex)
+// - A TX task (pinned to TASK_CORE) drives the queue; the hook runs on that task, with no
+//   TX lock held, so it may call back into send()
+
+class EspNowTx
+{
+public:
+  static constexpr uint8_t QUEUE_SIZE = 16;
+  static constexpr uint8_t MAC_RETRIES = 2;
+  // the driver reports every frame; this only unblocks the queue if a report is ever lost
+  static constexpr uint32_t CB_TIMEOUT_MS = 100;
+
+  static constexpr BaseType_t TASK_CORE = 0;
+  static constexpr UBaseType_t TASK_PRIO = 6; // above the engines, so queued frames go out first
+  static constexpr uint32_t TASK_STACK = 3072;
+
+  struct Stats
+  {
+    uint32_t sent = 0;      // frames handed to the driver (incl. resends)
+    uint32_t delivered = 0; // frames ACKed at MAC level
+    uint32_t failed = 0;    // frames dropped after MAC_RETRIES resends
+    uint32_t retries = 0;   // resends
+    uint32_t dropped = 0;   // send() calls rejected (queue full)
+  };
+
+  // delivered: MAC-level ACK received (false once all resends failed)
+  using ResultHook = void (*)(void *ctx, const uint8_t mac[6], bool delivered);
+
+  // Call after esp_now_init(); registers the send callback.
+  bool begin(ResultHook hook = nullptr, void *ctx = nullptr);
+  // Unregisters the callback and drops queued frames, each reported to the hook as not delivered
+  // (from the caller's task: don't call it with a lock the hook takes). Call before esp_now_deinit.
+  void end();
+
+  // Queues a copy of the frame. false if not started, the queue is full or len is too big.
+  bool send(const uint8_t mac[6], const uint8_t *data, size_t len);
+
+  Stats stats() const;
+  uint8_t queued() const;
+
+private:
+  struct Frame
+  {
+    uint8_t mac[6];
+    uint8_t len;
+    uint8_t attempts;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+  };
+
+  enum : uint8_t
+  {
+    CB_NONE = 0,
+    CB_OK,
+    CB_FAIL,
+  };
+
+  static void sentStatic(const uint8_t *mac, esp_now_send_status_t status);
+  static void taskStatic(void *arg);
+  void taskLoop();
+  void pump();
+  void finishHead(bool delivered);
+
+  Frame _q[QUEUE_SIZE];
+  uint8_t _head = 0;
+  uint8_t _count = 0;
+
+  bool _started = false;
+  bool _inFlight = false; // head frame is with the driver, waiting for the callback
+  uint32_t _sentAtMs = 0;
+  std::atomic<uint8_t> _cbStatus{CB_NONE};
+
+  ResultHook _hook = nullptr;
+  void *_hookCtx = nullptr;
+  Stats _stats;
+
+  SemaphoreHandle_t _mtx = nullptr;
+  TaskHandle_t _task = nullptr;
+
+  static EspNowTx *_self;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "SnapshotBuffer.h"
+
+// LoadCellSampler
+// - HX711 (channel A, gain 128), bit-banged by a dedicated task: nothing reads the sensor at
+//   request time, callers only copy the latest snapshot
+// - Raw samples go into a fixed ring (RING_SIZE); each new one is filtered: median of the last
+//   MEDIAN_N (spike rejection), then a first-order low-pass (y += (x - y) >> IIR_SHIFT)
+// - Variance of the last WINDOW filtered weights, kept incrementally (running sum / sum of
+//   squares, so each sample costs O(1)) in 1/16 g fixed point: sub-gram noise still counts.
+//   Reported rounded to g^2
+// - stable = window full and variance <= stableVariance (compared before rounding)
+//
+// Threading:
+// - The task is the only writer; snapshot() may be called from any task (lock-free double
+//   buffer, the RX path never waits on the sampler)
+// - requestTare() is applied by the task on its next sample (takeTare() reports the new offset
+//   so the owner can persist it outside the sampling path)
+
+class LoadCellSampler
+{
+public:
+  struct Config
+  {
+    int8_t doutPin = -1; // -1 = no load cell
+    int8_t sckPin = -1;
+    int32_t offset = 0;          // raw counts at zero load (tare)
+    int32_t countsPerKg = 420000; // calibration
+    uint16_t stableVariance = 4;  // g^2
+    uint32_t staleAfterMs = 1000; // no sample for this long -> ok=false
+  };
+
+  struct Snapshot
+  {
+    bool ok = false; // a sample arrived within staleAfterMs
+    bool stable = false;
+    int32_t weightG = 0;
+    uint16_t variance = 0; // g^2, saturated
+    uint32_t atMs = 0;     // millis() of the sample
+    uint32_t samples = 0;  // since begin()
+  };
+
+  static constexpr uint8_t RING_SIZE = 16;
+  static constexpr uint8_t MEDIAN_N = 5;
+  static constexpr uint8_t WINDOW = 16;
+  static constexpr uint8_t IIR_SHIFT = 2;
+
+  static constexpr BaseType_t TASK_CORE = 1;
+  static constexpr UBaseType_t TASK_PRIO = 3;
+  static constexpr uint32_t TASK_STACK = 2048;
+
+  // false if no pins are configured or the task could not start
+  bool begin(const Config &cfg);
+
+  // false before the first sample
+  bool snapshot(Snapshot &out) const;
+
+  void requestTare() { _tareRequested.store(true); }
+  // true once after a tare was applied; out = the new offset
+  bool takeTare(int32_t &out);
+
+private:
+  static void taskStatic(void *arg);
+  void taskLoop();
+  bool readRaw(int32_t &out);
+  void onSample(int32_t raw, uint32_t nowMs);
+  int32_t medianOfLast() const;
+  void resetWindow();
+
+  Config _cfg;
+
+  // task-owned filter state
+  int32_t _ring[RING_SIZE]{};
+  uint8_t _ringHead = 0;
+  uint8_t _ringCount = 0;
+  int32_t _iir = 0;
+  bool _iirInit = false;
+
+  int32_t _win[WINDOW]{}; // 1/16 g
+  uint8_t _winHead = 0;
+  uint8_t _winCount = 0;
+  int64_t _sum = 0;
+  int64_t _sumSq = 0;
+
+  std::atomic<bool> _tareRequested{false};
+  std::atomic<bool> _tareApplied{false};
+  std::atomic<int32_t> _offset{0};
+
+  SnapshotBuffer<Snapshot> _snap;
+  uint32_t _samples = 0;
+  portMUX_TYPE _ioMux = portMUX_INITIALIZER_UNLOCKED; // HX711 clocking
+
+  TaskHandle_t _task = nullptr;
+};
@@ -23,18 +23,21 @@ public:
     UpdateBeginFailed,
     StreamError,
     UpdateWriteFailed,
-    UpdateEndFailed
+    UpdateEndFailed,
+    Timeout
   };
 
   struct Config
   {
     uint32_t wifiTimeoutMs;
     uint32_t httpTimeoutMs;
+    uint32_t downloadTimeoutMs; // whole download (0 = none; httpTimeoutMs only bounds each read)
     bool allowInsecureIfNoCa;
 
     Config()
         : wifiTimeoutMs(20000),
           httpTimeoutMs(30000),
+          downloadTimeoutMs(0),
           allowInsecureIfNoCa(true)
     {
     }
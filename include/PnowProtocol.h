@@ -10,6 +10,10 @@ namespace pnow
     static constexpr uint8_t PN_VERSION = 1;
     static constexpr uint16_t PN_MAX_PAYLOAD = 200; // ESPNOW max is small; keep safe
 
+    // raw (not a pnow frame) liveness beacon sent by probes in ESP-NOW-only mode
+    static constexpr char PN_HEARTBEAT[] = "probe:heartbeat";
+    static constexpr size_t PN_HEARTBEAT_LEN = sizeof(PN_HEARTBEAT) - 1;
+
     enum MsgType : uint8_t
     {
         // Commands (GW -> Probe)
@@ -20,12 +24,18 @@ namespace pnow
         CMD_TELEMETRY = 5,
         CMD_WRITE = 6, // reserved for future use (write NVS key/val)
         CMD_OTA = 7,   // reserved for future use (start OTA with given URL)
+        CMD_CHANNEL = 8, // the gateway's WiFi channel changed (ChannelPayload)
         
         // Responses (Probe -> GW)
         RSP_ACK = 100,
         RSP_STATUS = 101,
         RSP_TELEMETRY = 102,
         RSP_ERR = 250,
+
+        // Events (Probe -> GW, unsolicited; seq from the probe's own push counter)
+        EVT_TELEMETRY = 103, // TelemetryPayload, reason = TEL_CHANGE / TEL_KEEPALIVE
+        EVT_PING = 104,      // no payload; probe looking for the gateway (channel scan), answered
+                             // with RSP_ACK (same seq), arg = the gateway's channel
     };
 
     enum ErrCode : uint8_t
@@ -39,6 +49,7 @@ namespace pnow
         ERR_NOT_SUPPORTED = 6,
         ERR_BUSY = 7,
         ERR_INVALID_STATE = 8,
+        ERR_TIMEOUT = 9, // the command's handler overran its budget (it may still finish)
     };
 
 #pragma pack(push, 1)
@@ -52,12 +63,19 @@ namespace pnow
         uint32_t crc32; // crc32 of (header_without_crc + payload)
     };
 
+    enum AckFlags : uint16_t
+    {
+        // ERR_REPLAY: seq is below the floor the probe resumed from after a reboot (its persisted
+        // seq ceiling), not a frame it has seen: nothing ran, the sender should move above arg
+        ACK_SEQ_FLOOR = 0x0001,
+    };
+
     struct AckPayload
     {
         uint8_t ok;  // 1/0
         uint8_t err; // ErrCode
-        uint16_t reserved;
-        uint32_t arg; // optional (e.g., nonce)
+        uint16_t flags; // AckFlags
+        uint32_t arg;   // optional (e.g., nonce; ERR_REPLAY: highest seq the probe rejects)
     };
 
     struct ResetPayload
@@ -65,15 +83,68 @@ namespace pnow
         uint32_t nonce; // required: two-step reset
     };
 
+    struct ChannelPayload
+    {
+        uint8_t channel; // 1..14
+        uint8_t rfu[3];
+    };
+
+    static constexpr uint8_t PN_CHANNEL_MAX = 14;
+    inline bool channel_valid(uint32_t ch) { return ch >= 1 && ch <= PN_CHANNEL_MAX; }
+
+    enum StatusFlags : uint8_t
+    {
+        STATUS_SCALE_OK = 0x01,     // load cell sampling
+        STATUS_SCALE_STABLE = 0x02, // weight settled
+    };
+
     struct StatusPayload
     {
         uint32_t uptime_s;
         int32_t last_weight_g;
-        uint8_t flags; // free for you
+        uint8_t flags; // StatusFlags
         uint8_t rfu[3];
     };
+
+    enum TelemetryReason : uint8_t
+    {
+        TEL_REPLY = 0,     // RSP_TELEMETRY to a CMD_TELEMETRY
+        TEL_CHANGE = 1,    // pushed: weight moved past the threshold or the tag changed
+        TEL_KEEPALIVE = 2, // pushed: nothing changed for a while
+    };
+
+    inline uint8_t tel_reason(uint8_t b) { return b & 0x03; }
+    inline uint8_t tel_change_count(uint8_t b) { return b >> 2; }
+    inline uint8_t tel_pack_reason(uint8_t reason, uint8_t changes) { return (uint8_t)((changes << 2) | (reason & 0x03)); }
+
+    struct TelemetryPayload
+    {
+        uint8_t ok; // 0 = no reading available yet
+        uint8_t reason; // bits 0-1 TelemetryReason, bits 2-7 change count (mod 64)
+        uint16_t variance;
+        int32_t weight_g;
+        uint32_t tag_at_ms;    // probe millis() of the last tag read
+        uint32_t weight_at_ms; // probe millis() of the weight sample
+        char uid[16];          // tag UID (hex), not necessarily null-terminated
+    };
 #pragma pack(pop)
 
+    // ERR_RATE_LIMIT AckPayload.arg: bits 0-15 milli-tokens left in the command's class,
+    // bits 16-31 ms until its next token (both saturated; arg = 0 from older probes)
+    inline uint32_t rate_limit_arg(uint32_t milliTokens, uint32_t waitMs)
+    {
+        if (milliTokens > 0xFFFF)
+            milliTokens = 0xFFFF;
+        if (waitMs > 0xFFFF)
+            waitMs = 0xFFFF;
+        return (waitMs << 16) | milliTokens;
+    }
+    inline uint16_t rate_limit_milli_tokens(uint32_t arg) { return (uint16_t)(arg & 0xFFFF); }
+    inline uint16_t rate_limit_wait_ms(uint32_t arg) { return (uint16_t)(arg >> 16); }
+
+    // max frame size on air (header + payload)
+    static constexpr uint16_t PN_MAX_FRAME = sizeof(Header) + PN_MAX_PAYLOAD;
+
     // -------------------- CRC32 (small & portable) --------------------
     inline uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
     {
@@ -102,6 +173,34 @@ namespace pnow
         return crc;
     }
 
+    // Payload already written at out + sizeof(Header): adds header + CRC. Returns frame size, 0 on error.
+    inline size_t seal_frame(uint8_t *out, size_t cap, uint8_t type, uint32_t seq, uint16_t len, uint32_t ts = 0)
+    {
+        if (len > PN_MAX_PAYLOAD || cap < sizeof(Header) + len)
+            return 0;
+
+        Header h{};
+        h.v = PN_VERSION;
+        h.type = type;
+        h.len = len;
+        h.seq = seq;
+        h.ts = ts;
+        h.crc32 = compute_crc(h, out + sizeof(Header));
+        memcpy(out, &h, sizeof(Header));
+        return sizeof(Header) + len;
+    }
+
+    // Writes header + payload + CRC into out (cap >= sizeof(Header) + len). Returns frame size, 0 on error.
+    inline size_t build_frame(uint8_t *out, size_t cap, uint8_t type, uint32_t seq,
+                              const void *payload, uint16_t len, uint32_t ts = 0)
+    {
+        if (len > PN_MAX_PAYLOAD || cap < sizeof(Header) + len)
+            return 0;
+        if (payload && len)
+            memcpy(out + sizeof(Header), payload, len);
+        return seal_frame(out, cap, type, seq, len, ts);
+    }
+
     inline bool validate_basic(const uint8_t *buf, int totalLen, Header &outH, const uint8_t *&outPayload)
     {
         if (totalLen < (int)sizeof(Header))
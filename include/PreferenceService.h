@@ -98,6 +98,7 @@ public:
 
   size_t getBytes(const char *key, void *outBuf, size_t maxLen) const;
   bool setBytes(const char *key, const void *buf, size_t len);
+  size_t getBytesLength(const char *key) const;
 
   bool removeKey(const char *key);
 
@@ -130,11 +131,17 @@ public:
   bool saveCaCertPem(const String &pem);
   bool clearCaCertPem();
 
-  // Topology JSON (raw)
+  // Topology JSON (raw, legacy: only read once to migrate to the blob)
   String loadTopologyJson() const;
   bool saveTopologyJson(const String &json);
   bool clearTopologyJson();
 
+  // Topology blob (compiled peer table, format owned by RunService)
+  size_t topologyBlobLength() const;
+  size_t loadTopologyBlob(void *buf, size_t maxLen) const;
+  bool saveTopologyBlob(const void *buf, size_t len);
+  bool clearTopologyBlob();
+
   // Debug
   void dumpToSerial(bool includeSecrets = false) const;
 
@@ -144,9 +151,23 @@ public:
   bool saveProbeNowConfig(const ProbeNowConfig &cfg);
   bool clearProbeNowConfig();
 
-  // Anti-replay: last accepted ESP-NOW sequence number
-  uint32_t getPnowLastSeq() const;
-  bool setPnowLastSeq(uint32_t seq);
+  // Probe anti-replay: every ESP-NOW seq ever accepted is <= this (reserved ahead, see ProbeRunService)
+  uint32_t getPnowSeqCeiling() const;
+  bool setPnowSeqCeiling(uint32_t seq);
+
+  // Gateway: every ESP-NOW seq ever sent is <= this (reserved ahead, see EspNowService)
+  uint32_t getPnowGwSeqCeiling() const;
+  bool setPnowGwSeqCeiling(uint32_t seq);
+
+  // Probe: WiFi channel the gateway was last reached on (0 = unknown, fast boot disabled)
+  uint8_t getPnowChannel() const;
+  bool setPnowChannel(uint8_t channel);
+
+  // Probe load cell: tare offset (raw counts) and calibration (counts per kg, 0 = firmware default)
+  int32_t getScaleOffset() const;
+  bool setScaleOffset(int32_t counts);
+  int32_t getScaleCountsPerKg() const;
+  bool setScaleCountsPerKg(int32_t counts);
 
 private:
   // Keys (keep short)
@@ -168,6 +189,7 @@ private:
 
   static constexpr const char *K_CA_PEM = "ca_pem";
   static constexpr const char *K_TOPOLOGY_JSON = "topology_json";
+  static constexpr const char *K_TOPOLOGY_BLOB = "topology_bin";
 
   // Setup/provisioning session codes
   static constexpr const char *K_PROV_CODE1 = "pairing";
@@ -178,6 +200,10 @@ private:
   static constexpr const char *K_PNOW_LMK = "pnow_lmk";
   static constexpr const char *K_PNOW_GWHMAC = "pnow_gwhmac";
   static constexpr const char *K_PNOW_SEQ = "pnow_seq";
+  static constexpr const char *K_PNOW_GWSEQ = "pnow_gwseq";
+  static constexpr const char *K_PNOW_CHAN = "pnow_chan";
+  static constexpr const char *K_SCALE_OFFSET = "scale_off";
+  static constexpr const char *K_SCALE_CPKG = "scale_cpkg";
 
 private:
   const char *_ns;
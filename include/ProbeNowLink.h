@@ -2,8 +2,19 @@
 #include <Arduino.h>
 #include <esp_now.h>
 #include <WiFi.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "SpscRing.h"
+#include "EspNowTx.h"
 
 // Minimal ESPNOW link for Probe -> Gateway (single peer)
+// - The WiFi receive callback only copies frames into a lock-free SPSC ring
+// - A dedicated RX task (pinned to TASK_CORE) drains the ring and calls the RxHandler,
+//   so handlers never run inside the WiFi driver task
+// - Sends go through EspNowTx (send-callback flow control, immediate MAC-level resend);
+//   frames lost in a row are counted so the owner can tell when the gateway has moved channel
 class ProbeNowLink
 {
 public:
@@ -12,25 +23,56 @@ public:
     uint8_t mac[6]{};
     uint8_t lmk[16]{};
     bool hasLmk = false;
+    uint8_t channel = 0; // gateway's WiFi channel; 0 = leave the radio where it is
   };
 
   using RxHandler = void (*)(const uint8_t *mac, const uint8_t *data, int len);
 
+  static constexpr BaseType_t TASK_CORE = 0;
+  static constexpr UBaseType_t TASK_PRIO = 5;
+  static constexpr uint32_t TASK_STACK = 6144;
+
   bool begin(const PeerConfig &peer, RxHandler onRx);
   void end();
   bool isReady() const { return _ready; }
 
+  // queued; false if the link is down or the TX queue is full
   bool send(const uint8_t *data, size_t len);
+  // delivery counters of the gateway link
+  EspNowTx::Stats txStats() const { return _tx.stats(); }
+  // frames lost in a row (no MAC-level ACK after all resends), 0 after any delivered one
+  uint8_t lossStreak() const { return _lossStreak.load(); }
+
+  // retunes the radio (not while WiFi is associated); the peer follows
+  bool setChannel(uint8_t channel);
+  uint8_t channel() const { return _peer.channel; }
 
   static bool parseMac(const String &s, uint8_t out[6]);
   // accept 32 hex chars or base64(16 bytes)
   static bool decodeKey16(const String &s, uint8_t out[16]);
 
 private:
+  struct RxFrame
+  {
+    uint8_t mac[6];
+    uint8_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+  };
+
+  static constexpr uint16_t RX_RING_SIZE = 8;
+
   bool _ready = false;
   PeerConfig _peer{};
   RxHandler _rx = nullptr;
 
+  SpscRing<RxFrame, RX_RING_SIZE> _ring;
+  EspNowTx _tx;
+  TaskHandle_t _task = nullptr;
+  std::atomic<uint8_t> _lossStreak{0};
+
+  static void txResultStatic(void *ctx, const uint8_t mac[6], bool delivered);
   static void recvStatic(const uint8_t *mac, const uint8_t *data, int len);
+  static void taskStatic(void *arg);
+  void taskLoop();
   static ProbeNowLink *_self;
 };
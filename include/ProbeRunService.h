@@ -1,10 +1,18 @@
 #pragma once
 #include <Arduino.h>
 #include <WebServer.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #include "PreferenceService.h"
 #include "ProbeNowLink.h"
+#include "PnowProtocol.h"
 #include "OtaService.h"
+#include "LoadCellSampler.h"
+#include "ReplayWindow.h"
+#include "TokenBucket.h"
+#include "SpscRing.h"
 
 // ProbeRunService
 // - Connects to WiFi
@@ -12,6 +20,29 @@
 // - Calls POST /api/device/register/probe with Bearer token
 // - Stores gatewayMac + lmk + gatewayHmac in NVS
 // - Disconnects WiFi and switches to ESPNOW-only
+// - Fast boot: once registered, the gateway's channel is cached in NVS and begin() goes
+//   straight to ESP-NOW on it; WiFi is only joined to learn the channel, and WiFi/HTTPS only
+//   come up for registration, OTA and token upkeep
+// - Token upkeep (ESP-NOW mode): loop() checks the stored token every tokenCheckEveryMs; when
+//   it nears expiry (or the clock isn't set yet) the executor joins WiFi, syncs time and
+//   refreshes it, then drops the association (retry after tokenRetryMs on failure)
+// - Anti-replay seq is persisted as a high-water mark: a ceiling SEQ_RESERVE ahead is written
+//   by the loop task before the gateway gets there (refill at SEQ_REFILL left), never on the RX
+//   path; after a reboot the probe resumes from the ceiling (the boot floor)
+// - Replay check is a 64-seq sliding window: reordered or retransmitted frames the probe has
+//   not run yet are accepted, duplicates and anything older than the window are not
+// - Rate limit: a token bucket per command class (control, telemetry, write); a rejected
+//   command gets ERR_RATE_LIMIT with the class's tokens left / time to the next one in arg
+// - Commands: the RX task only validates (CRC, replay, seq ceiling, rate limit) and answers
+//   STATUS/TELEMETRY from the lock-free sensor snapshot; everything with side effects (reboot,
+//   reset, tare, write, channel, OTA) is queued for an executor task, one at a time, which
+//   sends the ACK. A command arriving while one runs gets ERR_BUSY (the gateway resends), so
+//   the radio path never waits and pushes keep going from loop(), also during an OTA download.
+//   Watchdog: a command still running after cmdTimeoutMs (OTA: plus otaTimeoutMs) is answered
+//   ERR_TIMEOUT from loop(); one still running a further cmdTimeoutMs later reboots the probe
+// - Channel discovery: when frames to the gateway stop getting through, the probe pings it
+//   (EVT_PING) channel by channel and stays on the one it answers from; the gateway's own
+//   CMD_CHANNEL moves it directly. The channel is cached in NVS for the next (fast) boot
 
 class ProbeRunService
 {
@@ -21,9 +52,47 @@ public:
     const char *apiBase = "https://api.fluxspool.app";
     uint32_t tokenSkewSec = 60;
     uint32_t tokenCheckEveryMs = 30000;
+    uint32_t tokenRetryMs = 300000; // ESP-NOW mode: after a failed refresh (joins WiFi each time)
     uint32_t registerRetryMs = 2000;
+
+    // telemetry push (ESP-NOW mode): on change, else a keepalive when idle
+    int32_t pushWeightDeltaG = 5;
+    uint32_t pushMinIntervalMs = 250; // while the weight is still moving
+    uint32_t keepaliveMs = 5000;
+
+    // HX711 load cell (-1 = none; main.cpp sets the board's pins); calibration may be
+    // overridden in NVS
+    int8_t scaleDoutPin = -1;
+    int8_t scaleSckPin = -1;
+    int32_t scaleCountsPerKg = 420000;
+
+    // command rate limit per class: burst size, ms per refilled token
+    uint16_t controlBurst = 3; // reboot, reset, tare, OTA
+    uint32_t controlRefillMs = 1000;
+    uint16_t telemetryBurst = 10; // status, telemetry
+    uint32_t telemetryRefillMs = 100;
+    uint16_t writeBurst = 2;
+    uint32_t writeRefillMs = 2000;
+
+    // gateway channel discovery: after scanAfterLosses frames lost in a row, ping the gateway
+    // on every channel (scanDwellMs each); a scan that finds nothing is retried after
+    // scanRetryMs, doubling up to scanRetryMaxMs
+    uint8_t scanAfterLosses = 3;
+    uint32_t scanDwellMs = 80;
+    uint32_t scanRetryMs = 5000;
+    uint32_t scanRetryMaxMs = 60000;
+
+    // executor budget per command before it is answered ERR_TIMEOUT; OTA gets otaTimeoutMs
+    // (its download budget) on top
+    uint32_t cmdTimeoutMs = 1000;
+    uint32_t otaTimeoutMs = 300000;
   };
 
+  // executor task (WiFi runs on core 0; OTA needs the stack for TLS)
+  static constexpr BaseType_t EXEC_TASK_CORE = 1;
+  static constexpr UBaseType_t EXEC_TASK_PRIO = 2;
+  static constexpr uint32_t EXEC_TASK_STACK = 8192;
+
   ProbeRunService(PreferenceService &prefs, const Config &cfg);
 
   void begin();
@@ -37,6 +106,8 @@ private:
   bool tokenValidSoon() const;
   bool ensureValidToken();
   bool authRefresh();
+  bool tokenUpkeepDue() const;
+  void tokenUpkeep();
 
   bool registerProbe();
   bool httpPostJson(const String &url, const String &body, String &outResp, int &outCode);
@@ -51,10 +122,49 @@ private:
 
   static void onRxStatic(const uint8_t *mac, const uint8_t *data, int len);
   void onRx(const uint8_t *mac, const uint8_t *data, int len);
+
+  // a command with side effects, handed from the RX task to the executor
+  struct ExecCommand
+  {
+    uint8_t type = 0;
+    uint32_t seq = 0;
+    uint16_t len = 0;
+    uint8_t payload[pnow::PN_MAX_PAYLOAD]{};
+  };
+  static constexpr uint16_t EXEC_QUEUE_SIZE = 2; // one at a time; SpscRing needs 2 slots
+
+  static void execTaskStatic(void *arg);
+  void execLoop();
+  void execute(const ExecCommand &c);
+  // the command's one ACK: the executor's, or the watchdog's if it overran
+  void sendExecAck(uint32_t seq, bool ok, uint8_t err, uint32_t arg);
+  void checkExecWatchdog();
+
+  void sendFrame(uint8_t type, uint32_t seq, const void *payload, uint16_t len);
   void sendAck(uint32_t seq, bool ok, uint8_t err, uint32_t arg);
-  void handleOtaCommand(const String &url); 
-  
-private:
+  void sendStatus(uint32_t seq);
+  void sendTelemetry(uint32_t seq);
+
+  // current sensor state; ok=0 while there is none
+  void readTelemetry(pnow::TelemetryPayload &out) const;
+  bool telemetryChanged(const pnow::TelemetryPayload &cur) const;
+  void pushTelemetry(const pnow::TelemetryPayload &cur, uint8_t reason);
+  void handleOtaCommand(const String &url);
+  void persistSeqCeiling();
+
+  bool scanForGateway();
+  uint8_t pingGateway();
+  void useChannel(uint8_t channel);
+
+  enum CmdClass : uint8_t
+  {
+    CLASS_CONTROL = 0,
+    CLASS_TELEMETRY,
+    CLASS_WRITE,
+    CLASS_COUNT,
+  };
+  static uint8_t commandClass(uint8_t type);
+
   PreferenceService &_prefs;
   Config _cfg;
   OtaService _ota;
@@ -65,19 +175,51 @@ private:
   uint32_t _lastTokenCheckMs = 0;
   uint32_t _nextRegisterMs = 0;
 
-  uint32_t _lastHeartbeatMs = 0;
+  // last pushed reading (loop task only)
+  pnow::TelemetryPayload _pushed{};
+  bool _hasPushed = false;
+  uint32_t _pushSeq = 0;
+  uint8_t _pushChanges = 0; // lets the gateway spot a change push it missed
+  uint32_t _lastPushMs = 0;
+
+  static constexpr uint32_t SEQ_RESERVE = 1024;
+  static constexpr uint32_t SEQ_REFILL = SEQ_RESERVE / 2;
 
-  uint32_t _lastSeqSeen = 0;
-  uint32_t _lastCmdAtMs = 0;
+  ReplayWindow _replay;      // RX task
+  uint32_t _seqFloor = 0;    // ceiling found at boot: seqs <= it may have run before the reboot
+  std::atomic<uint32_t> _seqCeiling{0};       // persisted
+  std::atomic<uint32_t> _seqCeilingWanted{0}; // raised by the RX task, written by loop()
+  TokenBucket _buckets[CLASS_COUNT]; // RX task
 
   uint8_t _gatewayMac[6]{};
   bool _gatewayMacCached = false;
 
-  // RESET two-step
+  // channel discovery (loop task; the RX task only hands over what the gateway said)
+  std::atomic<uint32_t> _pingSeq{0};
+  std::atomic<uint8_t> _pingChannel{0};      // from the ping's ack, 0 = none yet
+  std::atomic<uint8_t> _announcedChannel{0}; // from CMD_CHANNEL, 0 = none pending
+  std::atomic<bool> _linkRestart{false};      // set by the executor (failed OTA), done by loop()
+  uint32_t _nextScanMs = 0;
+  uint32_t _scanRetryMs = 0; // 0 = last scan succeeded
+
+  // executor (RX task enqueues, executor task runs); busy from enqueue until it finished
+  SpscRing<ExecCommand, EXEC_QUEUE_SIZE> _exec;
+  std::atomic<bool> _execBusy{false};
+  std::atomic<uint32_t> _execSeq{0}; // seq being run (its retransmits are dropped, the ACK follows)
+  TaskHandle_t _execTask = nullptr;
+  std::atomic<bool> _execRunning{false}; // a command (not token upkeep) is in execute()
+  std::atomic<uint8_t> _execType{0};
+  std::atomic<uint32_t> _execStartedMs{0};
+  std::atomic<bool> _execAcked{false};
+  std::atomic<bool> _tokenUpkeep{false};        // set by loop() (holding _execBusy), run by the executor
+  std::atomic<uint32_t> _nextTokenUpkeepMs{0};
+
+  // RESET two-step (executor task)
   bool _resetArmed = false;
   uint32_t _resetNonce = 0;
   uint32_t _resetArmedUntilMs = 0;
 
+  LoadCellSampler _scale;
   ProbeNowLink _link;
   static ProbeRunService *_self;
 };
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+// ReplayWindow
+// - Anti-replay for sequence numbers that may arrive out of order (IPsec style, RFC 4303 3.4.3)
+// - Remembers the highest seq accepted (top) and a 64-bit bitmap of the SIZE seqs below it:
+//   a seq is new if it is above top, or inside the window and its bit is clear
+// - Anything older than the window is rejected (can't tell whether it was seen)
+// - check() and mark() are split so a frame rejected for another reason doesn't burn its seq
+
+class ReplayWindow
+{
+public:
+  static constexpr uint32_t SIZE = 64;
+
+  // everything <= top counts as seen (resume after a reboot)
+  void reset(uint32_t top)
+  {
+    _top = top;
+    _bits = ~0ULL;
+  }
+
+  bool check(uint32_t seq) const
+  {
+    if (seq > _top)
+      return true;
+    const uint32_t back = _top - seq;
+    if (back >= SIZE)
+      return false;
+    return ((_bits >> back) & 1ULL) == 0;
+  }
+
+  void mark(uint32_t seq)
+  {
+    if (seq > _top)
+    {
+      const uint32_t shift = seq - _top;
+      _bits = shift >= SIZE ? 0 : _bits << shift;
+      _bits |= 1ULL;
+      _top = seq;
+      return;
+    }
+    const uint32_t back = _top - seq;
+    if (back < SIZE)
+      _bits |= 1ULL << back;
+  }
+
+  uint32_t top() const { return _top; }
+
+private:
+  uint32_t _top = 0;
+  uint64_t _bits = ~0ULL; // bit i = seq (top - i) seen
+};
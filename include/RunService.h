@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 
 #include "PreferenceService.h"
 #include "MqttService.h"
@@ -10,7 +11,24 @@
 // RunService (V14)
 // - Keeps the V13 behavior intact (WiFi+NTP, token refresh, MQTT register/confirm, status/telemetry cadence)
 // - Adds ESPNOW polling for probes on command: TelemetryDevice
-// - Does NOT change topic names; topics remain exactly as in V13.
+// - TelemetryAll: polls every peer (or a MAC list) concurrently, publishes one aggregated result
+// - Background poller keeps a per-probe telemetry cache: TelemetryDevice is served from a fresh
+//   snapshot when possible, and the periodic telemetry publish carries the fleet data
+// - Topology handshake: register carries topologyHash (see topologyHash()); topology/result may
+//   answer {"unchanged":true}, a full probe list, or a delta
+//   {"baseHash","add":[probe...],"remove":[mac...],"hash"} applied to the peer table + NVS copy.
+//   A delta whose baseHash (or resulting hash) doesn't match re-registers with the real hash.
+// - Probe commands may carry "deadlineMs" (budget from receipt): work still queued past it is
+//   dropped and answered "deadline_exceeded"
+// - Probe commands over pnow: StatusDevice, TareDevice, RebootDevice, ResetDevice, OtaDevice
+// - Probe presence: online/offline edges from passive liveness (heartbeats, any probe frame) are
+//   published on probe/presence; telemetry entries carry online/rssi as the level state
+// - Probes push telemetry on change: each change is published right away on telemetry (same
+//   document shape, one probe, "push":true); the background poller skips probes that push
+//   while their pushes can be heard (see EspNowService)
+// - Link metrics per probe (requests/responses/timeouts/retries, MAC delivery, RTT histogram,
+//   RSSI) on espnow/metrics: periodically (metricsEveryMs) and on the EspNowMetrics command
+// - Does NOT change V13 topic names (probe/presence and espnow/metrics are new).
 
 class RunService
 {
@@ -27,14 +45,30 @@ public:
     // periodic status/telemetry when registered
     uint32_t statusEveryMs = 60000;
     uint32_t telemetryEveryMs = 60000;
+    uint32_t metricsEveryMs = 300000; // espnow/metrics, 0 = command only
 
     // token refresh
     uint32_t tokenCheckEveryMs = 30000;
     uint32_t tokenSkewSec = 60;
 
-    // espnow
+    // espnow (espnowTimeoutMs = initial timeout until a probe's RTT is measured)
     uint32_t espnowTimeoutMs = 1200;
     uint8_t espnowRetries = 1;
+    uint32_t espnowRtoMinMs = 30;
+    uint32_t espnowRtoMaxMs = 4000;
+    bool espnowRssiSniffer = false; // promiscuous mode for per-probe RSSI (else reported as 0)
+
+    // circuit breaker: consecutive timeouts before a probe is reported offline, retry after
+    uint8_t espnowBreakerThreshold = 3;
+    uint32_t espnowBreakerOpenMs = 10000;
+
+    // probe presence: offline after this long without any frame (3 missed 5 s heartbeats)
+    uint32_t probeOfflineAfterMs = 16000;
+
+    // background probe poller (one probe per tick, 0 = off) + cache freshness for TelemetryDevice;
+    // the tick shortens with the fleet so a full round fits in 3/4 of the max age
+    uint32_t probePollEveryMs = 1000;
+    uint32_t telemetryMaxAgeMs = 30000;
   };
 
   RunService(PreferenceService &prefs, MqttService &mqtt, const Config &cfg);
@@ -61,6 +95,10 @@ private:
   void publishRegister();
   void publishStatusIfDue();
   void publishTelemetryIfDue();
+  void publishPresence(const uint8_t mac[6], bool online, int8_t rssi);
+  void publishPushedTelemetry(const uint8_t mac[6], const EspNowService::TelemetryResponse &r);
+  void publishMetricsIfDue();
+  void publishMetrics(const String &correlationId);
 
   // mqtt handlers
   static void onRegisterConfirmStatic(char *topic, byte *payload, unsigned int length);
@@ -71,20 +109,80 @@ private:
   void onCommand(char *topic, byte *payload, unsigned int length);
   void onTopologyResult(char *topic, byte *payload, unsigned int length);
 
+  void handleProbeCommand(const String &cmd, const String &correlationId, const JsonDocument &doc);
+
+  // TelemetryAll fan-out
+  void handleTelemetryAll(const String &correlationId, JsonArrayConst macs, uint32_t deadlineMs);
+  void pumpFanOut();
+  void publishFanOutResult();
+  void publishCommandResult(const JsonDocument &doc);
+  // optional "deadlineMs": time budget of a command from now (0 = none)
+  static uint32_t commandDeadlineMs(const JsonDocument &doc);
+  static void writeProbeTelemetry(JsonObject o, const EspNowService::TelemetryResponse &r);
+
   // topics
   String deviceKey() const;                 // auth_dkey
   String topicOf(const char *suffix) const; // device/{deviceKey}/{suffix}
 
   // topology -> espnow
   void loadTopologyFromNvs();
+  // Upserts every probe of a full topology document and removes peers it no longer lists.
+  uint32_t applyTopologyFull(const JsonDocument &doc, bool &ok);
+  void applyTopologyDelta(const JsonDocument &doc);
+  static bool parseTopologyProbe(JsonVariantConst v, EspNowService::Peer &out);
+  // Order-independent: sum over peers of CRC32(mac | lmk (zeros if none) | deviceKey), 8 hex chars.
+  String topologyHash() const;
+  // compiled peer table in NVS (the raw JSON is only parsed when the cloud sends a topology)
+  bool saveTopologyBlob();
+  bool loadTopologyBlob(uint16_t &loaded);
+
+  // topology blob: TopoBlobHeader + count records, each
+  //   mac[6] | flags (TOPO_FLAG_LMK) | keyLen | lmk[16] if TOPO_FLAG_LMK | deviceKey[keyLen]
+  static constexpr uint32_t TOPO_MAGIC = 0x4F504F54; // "TOPO"
+  static constexpr uint8_t TOPO_VERSION = 1;
+  static constexpr uint8_t TOPO_FLAG_LMK = 0x01;
+
+#pragma pack(push, 1)
+  struct TopoBlobHeader
+  {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t rfu;
+    uint16_t count;
+    uint32_t crc32; // over the records
+  };
+#pragma pack(pop)
+
+  // probes per published message (keeps each page well under the MQTT buffer)
+  static constexpr uint8_t PROBE_PAGE_SIZE = 10;
+  static constexpr uint8_t METRICS_PAGE_SIZE = 6; // entries carry the RTT histogram
+
+  struct FanOutProbe
+  {
+    uint8_t mac[6]{};
+    bool done = false;
+    EspNowService::TelemetryResponse r;
+  };
+
+  struct FanOut
+  {
+    bool active = false;
+    String correlationId;
+    bool hasDeadline = false;
+    uint32_t deadlineAtMs = 0;
+    uint16_t count = 0;
+    uint16_t submitted = 0; // drip-fed into the ESPNOW queue as slots free up
+    uint16_t done = 0;
+    FanOutProbe probes[EspNowService::MAX_PEERS];
+  };
 
-private:
   PreferenceService &_prefs;
   MqttService &_mqtt;
   Config _cfg;
 
   EspNowService _esp;
   OtaService _ota;
+  FanOut _fanOut;
 
   bool _running = false;
   bool _mqttStarted = false;
@@ -94,6 +192,7 @@ private:
   uint32_t _lastRegisterMs = 0;
   uint32_t _lastStatusMs = 0;
   uint32_t _lastTelemetryMs = 0;
+  uint32_t _lastMetricsMs = 0;
   uint32_t _lastTokenCheckMs = 0;
 
   // static bridge for mqtt callbacks (PubSubClient style)
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <string.h>
+#include <stdint.h>
+
+// SnapshotBuffer
+// - Latest-value cell for ONE writer and any number of readers (task -> task/callback), no locks
+// - Double buffer: the writer fills the slot readers are not pointed at, then flips the index
+// - Each slot is also a seqlock (odd = being written), so a reader that gets lapped by two
+//   writes in a row notices and copies again instead of returning a torn value
+// - T must be trivially copyable (copied with memcpy)
+
+template <typename T>
+class SnapshotBuffer
+{
+public:
+  // ---- writer side ----
+  void write(const T &v)
+  {
+    const uint8_t next = _index.load(std::memory_order_relaxed) ^ 1;
+    Slot &s = _slots[next];
+    s.seq.fetch_add(1, std::memory_order_relaxed); // odd: in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&s.value, &v, sizeof(T));
+    s.seq.fetch_add(1, std::memory_order_release); // even: complete
+    _index.store(next, std::memory_order_release);
+  }
+
+  // ---- reader side ----
+  // false until the first write()
+  bool read(T &out) const
+  {
+    for (;;)
+    {
+      const Slot &s = _slots[_index.load(std::memory_order_acquire)];
+      const uint32_t before = s.seq.load(std::memory_order_acquire);
+      if (before == 0)
+        return false;
+      if (before & 1)
+        continue;
+      memcpy(&out, &s.value, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s.seq.load(std::memory_order_relaxed) == before)
+        return true;
+    }
+  }
+
+private:
+  struct Slot
+  {
+    std::atomic<uint32_t> seq{0};
+    T value{};
+  };
+
+  Slot _slots[2];
+  std::atomic<uint8_t> _index{0};
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// SpscRing
+// - Lock-free ring buffer for exactly ONE producer and ONE consumer (task <-> task, callback -> task)
+// - N must be a power of 2; capacity is N items, storage is static (no heap)
+// - Producer may fill a slot in place: T *slot = beginPush(); ...; commitPush();
+
+template <typename T, uint16_t N>
+class SpscRing
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of 2");
+
+public:
+  // ---- producer side ----
+  T *beginPush()
+  {
+    uint16_t head = _head.load(std::memory_order_relaxed);
+    uint16_t tail = _tail.load(std::memory_order_acquire);
+    if ((uint16_t)(head - tail) >= N)
+    {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &_buf[head & (N - 1)];
+  }
+
+  void commitPush()
+  {
+    _head.store((uint16_t)(_head.load(std::memory_order_relaxed) + 1), std::memory_order_release);
+  }
+
+  bool push(const T &v)
+  {
+    T *slot = beginPush();
+    if (!slot)
+      return false;
+    *slot = v;
+    commitPush();
+    return true;
+  }
+
+  bool push(T &&v)
+  {
+    T *slot = beginPush();
+    if (!slot)
+      return false;
+    *slot = static_cast<T &&>(v);
+    commitPush();
+    return true;
+  }
+
+  // ---- consumer side ----
+  bool pop(T &out)
+  {
+    uint16_t tail = _tail.load(std::memory_order_relaxed);
+    uint16_t head = _head.load(std::memory_order_acquire);
+    if (head == tail)
+      return false;
+    out = static_cast<T &&>(_buf[tail & (N - 1)]);
+    _tail.store((uint16_t)(tail + 1), std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const
+  {
+    return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+  }
+
+  // items rejected because the ring was full
+  uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  T _buf[N];
+  std::atomic<uint16_t> _head{0};
+  std::atomic<uint16_t> _tail{0};
+  std::atomic<uint32_t> _dropped{0};
+};
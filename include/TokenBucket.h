@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+// TokenBucket
+// - Rate limit with bursts: up to burst tokens, one more every refillMs; a request takes one
+// - Level is kept in ms of refill time (one token = refillMs), so refill is exact integer math
+//   with no rounding drift
+// - Time is passed in (millis()), the bucket itself never reads the clock
+
+class TokenBucket
+{
+public:
+  // refillMs = 0: never refills (burst is a hard cap)
+  void configure(uint16_t burst, uint32_t refillMs, uint32_t nowMs)
+  {
+    _refillMs = refillMs;
+    _capMs = (uint32_t)burst * (refillMs > 0 ? refillMs : 1);
+    _levelMs = _capMs;
+    _lastMs = nowMs;
+  }
+
+  bool take(uint32_t nowMs)
+  {
+    refill(nowMs);
+    const uint32_t cost = _refillMs > 0 ? _refillMs : 1;
+    if (_levelMs < cost)
+      return false;
+    _levelMs -= cost;
+    return true;
+  }
+
+  // tokens left, in 1/1000 token
+  uint32_t milliTokens() const
+  {
+    const uint32_t unit = _refillMs > 0 ? _refillMs : 1;
+    return (uint32_t)((uint64_t)_levelMs * 1000 / unit);
+  }
+
+  // time until the next whole token (0 = one is available, UINT32_MAX = never)
+  uint32_t msUntilToken() const
+  {
+    if (_refillMs == 0)
+      return _levelMs >= 1 ? 0 : UINT32_MAX;
+    return _levelMs >= _refillMs ? 0 : _refillMs - _levelMs;
+  }
+
+private:
+  void refill(uint32_t nowMs)
+  {
+    const uint32_t elapsed = nowMs - _lastMs;
+    _lastMs = nowMs;
+    if (_refillMs == 0)
+      return;
+    _levelMs = (_capMs - _levelMs <= elapsed) ? _capMs : _levelMs + elapsed;
+  }
+
+  uint32_t _refillMs = 0;
+  uint32_t _capMs = 0;
+  uint32_t _levelMs = 0;
+  uint32_t _lastMs = 0;
+};
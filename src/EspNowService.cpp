@@ -2,218 +2,1827 @@
 
 EspNowService *EspNowService::_self = nullptr;
 
-#pragma pack(push, 1)
-struct TelemetryReq
+namespace
 {
-  uint8_t type; // 1
-  uint8_t corr[16];
-};
+  // holds the engine mutex for a scope (no-op before begin())
+  struct EngineLock
+  {
+    explicit EngineLock(SemaphoreHandle_t m) : _m(m)
+    {
+      if (_m)
+        xSemaphoreTake(_m, portMAX_DELAY);
+    }
+    ~EngineLock()
+    {
+      if (_m)
+        xSemaphoreGive(_m);
+    }
+    SemaphoreHandle_t _m;
+  };
+}
+
+EspNowService::EspNowService(PreferenceService &prefs) : _prefs(prefs) {}
+
+bool EspNowService::begin()
+{
+  // ESPNOW needs STA or AP_STA (never WIFI_OFF)
+  wifi_mode_t mode = WiFi.getMode();
+  if (mode == WIFI_OFF)
+    WiFi.mode(WIFI_STA);
+  else if (mode == WIFI_AP)
+    WiFi.mode(WIFI_AP_STA);
+
+  if (esp_now_init() != ESP_OK)
+    return false;
+
+  if (!_mtx)
+    _mtx = xSemaphoreCreateMutex();
+  if (!_timer)
+  {
+    esp_timer_create_args_t args{};
+    args.callback = &EspNowService::timerStatic;
+    args.arg = this;
+    args.name = "espnow_rto";
+    if (esp_timer_create(&args, &_timer) != ESP_OK)
+      _timer = nullptr;
+  }
+  if (!_task)
+    xTaskCreatePinnedToCore(&EspNowService::taskStatic, "espnow", TASK_STACK, this, TASK_PRIO, &_task, TASK_CORE);
+
+  if (!_mtx || !_timer || !_task || !_tx.begin(&EspNowService::txResultStatic, this))
+  {
+    Serial.println("[ESPNOW] engine task init failed");
+    esp_now_deinit();
+    return false;
+  }
+
+  // every seq sent before this boot is <= the stored ceiling
+  {
+    EngineLock lock(_mtx);
+    _seqCeiling = _prefs.getPnowGwSeqCeiling();
+    _seqHigh = max(_seqHigh, _seqCeiling);
+  }
+
+  _self = this;
+  esp_now_register_recv_cb(&EspNowService::recvStatic);
+  return true;
+}
+
+bool EspNowService::setRssiSniffer(bool enable)
+{
+  esp_err_t err;
+  if (!enable)
+  {
+    err = esp_wifi_set_promiscuous(false);
+    if (err != ESP_OK)
+      Serial.printf("[ESPNOW] rssi sniffer off failed: %s\n", esp_err_to_name(err));
+    return err == ESP_OK;
+  }
+
+  // the recv callback doesn't carry RSSI, the sniffer sees the same frame just before
+  wifi_promiscuous_filter_t filter{};
+  filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+  err = esp_wifi_set_promiscuous_filter(&filter);
+  if (err == ESP_OK)
+    err = esp_wifi_set_promiscuous_rx_cb(&EspNowService::sniffStatic);
+  if (err == ESP_OK)
+    err = esp_wifi_set_promiscuous(true);
+  if (err != ESP_OK)
+  {
+    Serial.printf("[ESPNOW] rssi sniffer unavailable: %s\n", esp_err_to_name(err));
+    return false;
+  }
+  return true;
+}
+
+void EspNowService::loop()
+{
+  checkChannel();
+
+  // callbacks run here (caller's task), never in the WiFi or engine task
+  Completion c;
+  while (_done.pop(c))
+  {
+    {
+      EngineLock lock(_mtx);
+      _cbOutstanding--;
+    }
+    if (c.cb)
+      c.cb(c.r);
+    c.cb = nullptr;
+  }
+
+  PresenceEvent e;
+  while (_presence.pop(e))
+  {
+    if (_presenceCb)
+      _presenceCb(e.mac, e.online, e.rssi);
+  }
+
+  PushEvent pe;
+  while (_pushes.pop(pe))
+  {
+    if (_pushCb)
+      _pushCb(pe.mac, pe.r);
+  }
+}
+
+// -------------------- Engine task --------------------
+void EspNowService::taskStatic(void *arg)
+{
+  static_cast<EspNowService *>(arg)->taskLoop();
+}
+
+void EspNowService::timerStatic(void *arg)
+{
+  static_cast<EspNowService *>(arg)->wakeEngine();
+}
+
+void EspNowService::wakeEngine()
+{
+  if (_task)
+    xTaskNotifyGive(_task);
+}
+
+void EspNowService::taskLoop()
+{
+  for (;;)
+  {
+    // woken by: received frame, new request, or the deadline timer
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uint32_t waitMs;
+    {
+      EngineLock lock(_mtx);
+
+      uint32_t nowMs = millis();
+      RxFrame f;
+      while (_rx.pop(f))
+      {
+        // beacons: raw heartbeat (older probes), a telemetry push or a channel-scan ping
+        const uint8_t type = f.len >= sizeof(pnow::Header) ? f.data[offsetof(pnow::Header, type)] : 0;
+        bool beacon = (f.len == pnow::PN_HEARTBEAT_LEN && memcmp(f.data, pnow::PN_HEARTBEAT, pnow::PN_HEARTBEAT_LEN) == 0) ||
+                      type == pnow::EVT_TELEMETRY || type == pnow::EVT_PING;
+        noteSeen(f.mac, f.rssi, beacon, nowMs);
+        onRecv(f.mac, f.data, f.len);
+      }
+
+      serviceLiveness(nowMs);
+      serviceDeadlines(nowMs);
+
+      const uint32_t pollTick = pollTickMs();
+      if (pollTick > 0 && nowMs - _lastPollMs >= pollTick)
+      {
+        _lastPollMs = nowMs;
+        pollNextPeer();
+      }
+
+      releaseStaleDriverSlots();
+      processQueue();
+      waitMs = msUntilNextDeadline(millis());
+    }
+
+    esp_timer_stop(_timer);
+    if (waitMs != UINT32_MAX)
+      esp_timer_start_once(_timer, (uint64_t)waitMs * 1000ULL);
+  }
+}
+
+void EspNowService::serviceDeadlines(uint32_t nowMs)
+{
+  // each in-flight request has its own deadline: a dead peer only delays its own callers
+  for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+  {
+    Pending &p = _inflight[i];
+    if (!p.active)
+      continue;
+
+    if (expireWaiters(p.waiters, nowMs))
+    {
+      // every caller gave up: no point in retrying (a late reply is ignored)
+      p.active = false;
+      continue;
+    }
+    if ((int32_t)(nowMs - p.deadlineMs) < 0)
+      continue;
+
+    if (p.holdSend)
+    {
+      // deferred send (rate-limited by the probe, or reset confirm): the probe did not run
+      // the previous frame, so a fresh seq is always safe
+      p.holdSend = false;
+      sendReq(p, true);
+      p.deadlineMs = nowMs + p.timeoutMs;
+    }
+    else if (p.retriesLeft > 0)
+    {
+      p.retriesLeft--;
+      backoffRto(p.mac);
+      if (LinkStats *ls = linkOf(p.mac))
+        ls->retries++;
+      p.timeoutMs = min(p.timeoutMs * 2, _rtoMaxMs);
+      // STATUS/TELEMETRY are simply asked again; anything else is resent with the same seq,
+      // so a probe that already ran it answers ERR_REPLAY instead of running it twice
+      sendReq(p, isIdempotent(p.type));
+      p.deadlineMs = nowMs + p.timeoutMs;
+    }
+    else
+    {
+      failPending(i, Error::Timeout);
+    }
+  }
+}
+
+uint32_t EspNowService::msUntilNextDeadline(uint32_t nowMs) const
+{
+  uint32_t best = UINT32_MAX;
+  for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+  {
+    const Pending &p = _inflight[i];
+    if (!p.active)
+      continue;
+    int32_t d = (int32_t)(p.deadlineMs - nowMs);
+    best = min<uint32_t>(best, d > 0 ? (uint32_t)d : 0);
+  }
+
+  for (uint8_t i = 0; i < MAX_WAITERS; i++)
+  {
+    const Waiter &w = _waiters[i];
+    if (!w.used || !w.hasDeadline)
+      continue;
+    int32_t d = (int32_t)(w.deadlineMs - nowMs);
+    best = min<uint32_t>(best, d > 0 ? (uint32_t)d : 0);
+  }
+
+  if (_offlineAfterMs > 0)
+  {
+    for (uint16_t i = 0; i < _peerCount; i++)
+    {
+      const PeerState &st = _state[i];
+      if (!st.online || st.confirming)
+        continue;
+      // still online past its deadline: its confirmation poll waits for queue room, retry soon
+      int32_t d = (int32_t)(st.lastSeenMs + _offlineAfterMs - nowMs);
+      best = min<uint32_t>(best, d > 0 ? (uint32_t)d : POLL_MIN_TICK_MS);
+    }
+  }
+
+  const uint32_t pollTick = pollTickMs();
+  if (pollTick > 0 && _peerCount > 0)
+  {
+    uint32_t since = nowMs - _lastPollMs;
+    best = min<uint32_t>(best, since >= pollTick ? 0 : pollTick - since);
+  }
+
+  // wake at least once right after the deadline (timer granularity is us, millis() is ms)
+  return best == UINT32_MAX ? best : best + 1;
+}
+
+void EspNowService::setRtoBounds(uint32_t minMs, uint32_t maxMs)
+{
+  EngineLock lock(_mtx);
+  _rtoMinMs = minMs;
+  _rtoMaxMs = max(minMs, maxMs);
+}
+
+uint32_t EspNowService::rtoFor(const uint8_t mac[6], uint32_t initialMs) const
+{
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return min(max(initialMs, _rtoMinMs), _rtoMaxMs);
+
+  const PeerState &st = _state[_index[slot] - 1];
+  // RTO = SRTT + 4 * RTTVAR
+  uint32_t rto = st.hasRtt ? (st.srtt8 >> 3) + max<uint32_t>(1, st.rttvar4) : initialMs;
+  rto = min(max(rto, _rtoMinMs), _rtoMaxMs);
+  for (uint8_t i = 0; i < st.backoff && rto < _rtoMaxMs; i++)
+    rto *= 2;
+  return min(rto, _rtoMaxMs);
+}
+
+void EspNowService::sampleRtt(const uint8_t mac[6], uint32_t rttMs)
+{
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return;
+
+  PeerState &st = _state[_index[slot] - 1];
+  uint8_t b = 0;
+  while (b < RTT_BUCKETS - 1 && rttMs > rttBucketLimitMs(b))
+    b++;
+  if (st.link.rttHist[b] < 0xFFFF)
+    st.link.rttHist[b]++;
+
+  st.backoff = 0;
+  if (!st.hasRtt)
+  {
+    // first sample: SRTT = R, RTTVAR = R/2
+    st.srtt8 = rttMs << 3;
+    st.rttvar4 = rttMs << 1;
+    st.hasRtt = true;
+    return;
+  }
+
+  // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R| ; SRTT = 7/8 SRTT + 1/8 R
+  int32_t err = (int32_t)rttMs - (int32_t)(st.srtt8 >> 3);
+  st.srtt8 = (uint32_t)((int32_t)st.srtt8 + err);
+  uint32_t absErr = (uint32_t)(err < 0 ? -err : err);
+  st.rttvar4 = st.rttvar4 - (st.rttvar4 >> 2) + absErr;
+}
+
+void EspNowService::backoffRto(const uint8_t mac[6])
+{
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return;
+  PeerState &st = _state[_index[slot] - 1];
+  if (st.backoff < 6)
+    st.backoff++;
+}
+
+void EspNowService::setPresenceCallback(PresenceCallback cb, uint32_t offlineAfterMs)
+{
+  {
+    EngineLock lock(_mtx);
+    _presenceCb = std::move(cb);
+    _offlineAfterMs = offlineAfterMs;
+  }
+  wakeEngine();
+}
+
+bool EspNowService::getLiveness(const uint8_t mac[6], Liveness &out) const
+{
+  EngineLock lock(_mtx);
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return false;
+  const PeerState &st = _state[_index[slot] - 1];
+  out.online = st.online;
+  out.seen = st.seen;
+  out.lastSeenAgoMs = st.seen ? millis() - st.lastSeenMs : 0;
+  out.rssi = st.rssi;
+  out.heartbeats = st.heartbeats;
+  out.lastGapMs = st.lastGapMs;
+  out.maxGapMs = st.maxGapMs;
+  return true;
+}
+
+void EspNowService::noteSeen(const uint8_t mac[6], int8_t rssi, bool heartbeat, uint32_t nowMs)
+{
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return; // not in the topology
+
+  PeerState &st = _state[_index[slot] - 1];
+  st.seen = true;
+  st.lastSeenMs = nowMs;
+  st.confirming = false;
+  if (rssi != 0)
+  {
+    st.rssi = rssi;
+    st.rssiAvg8 = st.rssiAvg8 == 0 ? rssi * 8 : st.rssiAvg8 + rssi - (st.rssiAvg8 >> 3);
+  }
+
+  if (heartbeat)
+  {
+    keepResident(mac);
+    if (st.heartbeats > 0)
+    {
+      st.lastGapMs = nowMs - st.lastHbMs;
+      st.maxGapMs = max(st.maxGapMs, st.lastGapMs);
+    }
+    st.lastHbMs = nowMs;
+    st.heartbeats++;
+  }
+
+  // heard from it: an open breaker may try right away
+  if (st.breaker == BREAKER_OPEN)
+    st.breakerOpenedMs = nowMs - _breakerOpenMs;
+
+  if (!st.online && _offlineAfterMs > 0)
+  {
+    st.online = true;
+    PresenceEvent e{};
+    memcpy(e.mac, mac, 6);
+    e.online = true;
+    e.rssi = st.rssi;
+    _presence.push(e);
+  }
+}
+
+void EspNowService::serviceLiveness(uint32_t nowMs)
+{
+  if (_offlineAfterMs == 0)
+    return;
+  for (uint16_t i = 0; i < _peerCount; i++)
+  {
+    PeerState &st = _state[i];
+    if (!st.online)
+      continue;
+    const uint8_t *mac = _peers[i].mac;
+    if (st.confirming)
+    {
+      // the poll's reply or timeout settles it; one shed from the queue is sent again
+      if (isMacInFlight(mac) || isMacQueued(mac))
+        continue;
+      st.confirming = false;
+    }
+    if (nowMs - st.lastSeenMs < _offlineAfterMs)
+      continue;
+
+    // no resident driver slot: its beacons may not have decrypted, silence proves nothing
+    if (!canHear(i) && st.breaker != BREAKER_OPEN)
+    {
+      if (!isMacInFlight(mac) && !isMacQueued(mac))
+        enqueueLocked(mac, pnow::CMD_TELEMETRY, nullptr, 0, nullptr, _pollTimeoutMs, _pollRetries, 0);
+      // not queued (queue full): asked again on a later pass
+      st.confirming = isMacInFlight(mac) || isMacQueued(mac);
+      continue;
+    }
+    goOffline(i);
+  }
+}
+
+void EspNowService::goOffline(uint16_t rec)
+{
+  PeerState &st = _state[rec];
+  st.online = false;
+  st.confirming = false;
+  int8_t ds = findDriverSlot(_peers[rec].mac);
+  if (ds >= 0)
+    _driver[ds].resident = false;
+
+  PresenceEvent e{};
+  memcpy(e.mac, _peers[rec].mac, 6);
+  e.online = false;
+  e.rssi = st.rssi;
+  _presence.push(e);
+}
+
+bool EspNowService::canHear(uint16_t rec) const
+{
+  if (!_peers[rec].hasLmk)
+    return true;
+  int8_t ds = findDriverSlot(_peers[rec].mac);
+  return ds >= 0 && _driver[ds].resident;
+}
+
+void EspNowService::setPushCallback(PushCallback cb)
+{
+  EngineLock lock(_mtx);
+  _pushCb = std::move(cb);
+}
+
+void EspNowService::resyncSeq(const uint8_t mac[6], uint32_t seq)
+{
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return;
+  PeerState &st = _state[_index[slot] - 1];
+  if (seq > st.txSeq)
+  {
+    Serial.printf("[ESPNOW] %s seq resync %lu -> %lu\n", macToString(mac).c_str(), (unsigned long)st.txSeq, (unsigned long)seq);
+    st.txSeq = seq;
+  }
+}
+
+void EspNowService::setPollInterval(uint32_t intervalMs, uint32_t timeoutMs, uint8_t retries, uint32_t sweepMs)
+{
+  {
+    EngineLock lock(_mtx);
+    _pollIntervalMs = intervalMs;
+    _pollSweepMs = sweepMs;
+    _pollTimeoutMs = timeoutMs;
+    _pollRetries = retries;
+  }
+  wakeEngine();
+}
+
+uint32_t EspNowService::pollTickMs() const
+{
+  if (_pollIntervalMs == 0 || _pollSweepMs == 0 || _peerCount == 0)
+    return _pollIntervalMs;
+  uint32_t tick = _pollSweepMs / _peerCount;
+  if (tick < POLL_MIN_TICK_MS)
+    tick = POLL_MIN_TICK_MS;
+  return tick < _pollIntervalMs ? tick : _pollIntervalMs;
+}
+
+void EspNowService::pollNextPeer()
+{
+  if (_peerCount == 0)
+    return;
+  // leave room for cloud-initiated requests
+  if (freeQueueSlots() < 2)
+    return;
+
+  if (_pollCursor >= _peerCount)
+    _pollCursor = 0;
+  const uint8_t *mac = _peers[_pollCursor].mac;
+  _pollCursor++;
+
+  // a request already on its way refreshes the snapshot anyway
+  if (isMacInFlight(mac) || isMacQueued(mac))
+    return;
+
+  // it tells us itself, as long as its pushes can reach us (without a resident driver slot an
+  // encrypted push doesn't decrypt: polling it keeps its slot warm until it turns resident)
+  int32_t slot = findIndexSlot(mac);
+  if (slot >= 0)
+  {
+    const uint16_t rec = _index[slot] - 1;
+    if (_state[rec].pushes && _state[rec].online && canHear(rec))
+      return;
+  }
+
+  enqueueLocked(mac, pnow::CMD_TELEMETRY, nullptr, 0, nullptr, _pollTimeoutMs, _pollRetries, 0);
+}
+
+void EspNowService::storeSnapshot(const uint8_t mac[6], const TelemetryResponse &r)
+{
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return;
+
+  PeerState &st = _state[_index[slot] - 1];
+  st.hasSnapshot = true;
+  st.snapshotAtMs = millis();
+  st.weight = r.weight;
+  st.variance = r.variance;
+  st.tagAtMs = r.tagAtMs;
+  st.weightAtMs = r.weightAtMs;
+  strlcpy(st.uid, r.uid.c_str(), sizeof(st.uid));
+}
+
+bool EspNowService::getSnapshot(const uint8_t mac[6], TelemetryResponse &out, uint32_t &ageMs) const
+{
+  EngineLock lock(_mtx);
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return false;
+
+  const PeerState &st = _state[_index[slot] - 1];
+  if (!st.hasSnapshot)
+    return false;
+
+  out.ok = true;
+  out.weight = st.weight;
+  out.variance = st.variance;
+  out.tagAtMs = st.tagAtMs;
+  out.weightAtMs = st.weightAtMs;
+  out.uid = String(st.uid);
+  ageMs = millis() - st.snapshotAtMs;
+  return true;
+}
+
+void EspNowService::Peer::setDeviceKey(const String &key)
+{
+  strlcpy(deviceKey, key.c_str(), sizeof(deviceKey));
+}
+
+uint16_t EspNowService::hashMac(const uint8_t mac[6])
+{
+  // FNV-1a; OUI bytes are shared across a fleet, so every byte is mixed in
+  uint32_t h = 2166136261u;
+  for (uint8_t i = 0; i < 6; i++)
+  {
+    h ^= mac[i];
+    h *= 16777619u;
+  }
+  return (uint16_t)((h ^ (h >> 16)) & INDEX_MASK);
+}
+
+int32_t EspNowService::findIndexSlot(const uint8_t mac[6]) const
+{
+  uint16_t pos = hashMac(mac);
+  for (uint16_t n = 0; n < INDEX_SIZE; n++)
+  {
+    uint16_t e = _index[pos];
+    if (e == 0)
+      return -1;
+    if (memcmp(_peers[e - 1].mac, mac, 6) == 0)
+      return pos;
+    pos = (pos + 1) & INDEX_MASK;
+  }
+  return -1;
+}
+
+const EspNowService::Peer *EspNowService::findPeer(const uint8_t mac[6]) const
+{
+  int32_t slot = findIndexSlot(mac);
+  return slot < 0 ? nullptr : &_peers[_index[slot] - 1];
+}
+
+bool EspNowService::upsertPeer(const Peer &p)
+{
+  EngineLock lock(_mtx);
+  int32_t slot = findIndexSlot(p.mac);
+  if (slot >= 0)
+  {
+    Peer &old = _peers[_index[slot] - 1];
+    const bool keyChanged = old.hasLmk != p.hasLmk || (p.hasLmk && memcmp(old.lmk, p.lmk, 16) != 0);
+    old = p;
+    // same key (e.g. a full topology re-sent): the driver entry stays, resident or not
+    if (!keyChanged)
+      return true;
+    // key changed: drop the driver entry (re-added on next use), or update it in place while
+    // the peer is busy
+    int8_t ds = findDriverSlot(p.mac);
+    if (ds >= 0 && !driverPinned(ds))
+    {
+      releaseDriverSlot(ds);
+    }
+    else if (ds >= 0 && _driver[ds].encrypted == p.hasLmk)
+    {
+      esp_now_peer_info_t info{};
+      memcpy(info.peer_addr, p.mac, 6);
+      info.encrypt = p.hasLmk;
+      memcpy(info.lmk, p.lmk, 16);
+      esp_now_mod_peer(&info);
+    }
+    else if (ds >= 0)
+    {
+      // encryption switched on/off (counts against the encrypted slots): re-added once the
+      // slot is unpinned (the engine releases stale slots, onTxResult wakes it)
+      _driver[ds].stale = true;
+    }
+    return true;
+  }
+
+  if (_peerCount >= MAX_PEERS)
+    return false;
+
+  uint16_t pos = hashMac(p.mac);
+  while (_index[pos] != 0)
+    pos = (pos + 1) & INDEX_MASK;
+
+  _peers[_peerCount] = p;
+  _state[_peerCount] = PeerState{};
+  _index[pos] = ++_peerCount;
+  return true;
+}
+
+bool EspNowService::removePeer(const uint8_t macIn[6])
+{
+  // macIn may point into _peers, which is reshuffled below
+  uint8_t mac[6];
+  memcpy(mac, macIn, 6);
+
+  EngineLock lock(_mtx);
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return false;
+
+  uint16_t rec = _index[slot] - 1;
+
+  // its pending work can't be answered anymore: say so now instead of timing out
+  failQueued(mac, Error::PeerRemoved);
+  for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+  {
+    if (_inflight[i].active && memcmp(_inflight[i].mac, mac, 6) == 0)
+      failPending(i, Error::PeerRemoved);
+  }
+
+  // backward-shift deletion keeps probe chains intact without tombstones
+  uint16_t hole = (uint16_t)slot;
+  _index[hole] = 0;
+  uint16_t j = hole;
+  while (true)
+  {
+    j = (j + 1) & INDEX_MASK;
+    if (_index[j] == 0)
+      break;
+    uint16_t home = hashMac(_peers[_index[j] - 1].mac);
+    // move entry j into the hole unless its home lies cyclically in (hole, j]
+    bool homeInRange = (hole <= j) ? (home > hole && home <= j) : (home > hole || home <= j);
+    if (!homeInRange)
+    {
+      _index[hole] = _index[j];
+      _index[j] = 0;
+      hole = j;
+    }
+  }
+
+  // keep records dense: move the last record into the freed one
+  uint16_t last = _peerCount - 1;
+  if (rec != last)
+  {
+    int32_t lastSlot = findIndexSlot(_peers[last].mac);
+    _peers[rec] = _peers[last];
+    _state[rec] = _state[last];
+    if (lastSlot >= 0)
+      _index[lastSlot] = rec + 1;
+  }
+  _peers[last] = Peer{};
+  _state[last] = PeerState{};
+  _peerCount--;
+
+  // frames still in EspNowTx need the driver entry: released once they are reported
+  int8_t ds = findDriverSlot(mac);
+  if (ds >= 0)
+  {
+    _driver[ds].stale = true;
+    releaseStaleDriverSlots();
+  }
+  wakeEngine();
+  return true;
+}
+
+bool EspNowService::requestTelemetryByMac(const uint8_t mac[6],
+                                          TelemetryCallback cb,
+                                          uint32_t timeoutMs,
+                                          uint8_t retries,
+                                          uint32_t deadlineMs)
+{
+  ReplyCallback rcb;
+  if (cb)
+    rcb = [cb](const Reply &r)
+    { cb(r.tel); };
+
+  bool ok;
+  {
+    EngineLock lock(_mtx);
+    ok = enqueueLocked(mac, pnow::CMD_TELEMETRY, nullptr, 0, rcb, timeoutMs, retries, deadlineMs);
+  }
+  if (ok)
+    wakeEngine();
+  return ok;
+}
+
+bool EspNowService::sendCommand(const uint8_t mac[6],
+                                pnow::MsgType cmd,
+                                const uint8_t *payload,
+                                uint16_t len,
+                                CommandCallback cb,
+                                uint32_t timeoutMs,
+                                uint8_t retries,
+                                uint32_t deadlineMs)
+{
+  // telemetry has its own response type (requestTelemetryByMac)
+  if (cmd == pnow::CMD_TELEMETRY || len > pnow::PN_MAX_PAYLOAD)
+    return false;
+
+  pnow::ResetPayload rp{};
+  if (cmd == pnow::CMD_RESET && len < sizeof(rp))
+  {
+    rp.nonce = esp_random();
+    payload = (const uint8_t *)&rp;
+    len = sizeof(rp);
+  }
+
+  ReplyCallback rcb;
+  if (cb)
+    rcb = [cb](const Reply &r)
+    { cb(r.cmd); };
+
+  bool ok;
+  {
+    EngineLock lock(_mtx);
+    ok = enqueueLocked(mac, cmd, payload, len, rcb, timeoutMs, retries, deadlineMs);
+  }
+  if (ok)
+    wakeEngine();
+  return ok;
+}
+
+bool EspNowService::enqueueLocked(const uint8_t mac[6], uint8_t type, const uint8_t *payload, uint16_t len,
+                                  ReplyCallback cb, uint32_t timeoutMs, uint8_t retries, uint32_t deadlineMs)
+{
+  if (cb && _cbOutstanding >= DONE_RING_SIZE)
+    return false;
+
+  if (isIdempotent(type))
+  {
+    // same question already on its way or waiting: one radio exchange answers every caller
+    for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+    {
+      Pending &p = _inflight[i];
+      if (p.active && p.type == type && memcmp(p.mac, mac, 6) == 0)
+      {
+        p.retriesLeft = max(p.retriesLeft, retries);
+        if (cb)
+          addWaiter(p.waiters, std::move(cb), deadlineMs);
+        return true;
+      }
+    }
+    for (uint8_t i = 0; i < MAX_QUEUE; i++)
+    {
+      QueueItem &q = _queue[i];
+      if (q.used && q.type == type && memcmp(q.mac, mac, 6) == 0)
+      {
+        q.retries = max(q.retries, retries);
+        q.prio = min<uint8_t>(q.prio, priorityOf(type, (bool)cb));
+        if (cb)
+          addWaiter(q.waiters, std::move(cb), deadlineMs);
+        return true;
+      }
+    }
+  }
+
+  if (!breakerAdmits(mac, millis()))
+  {
+    // answered right away (through loop(), like any other result); polls just skip the peer
+    if (cb)
+    {
+      int8_t one = -1;
+      addWaiter(one, std::move(cb), 0);
+      Reply r;
+      r.tel.error = Error::ProbeOffline;
+      r.cmd.error = Error::ProbeOffline;
+      completeWaiters(one, r);
+    }
+    return true;
+  }
+
+  const Priority prio = priorityOf(type, (bool)cb);
+  int8_t slot = -1;
+  int8_t poll = -1;
+  for (uint8_t i = 0; i < MAX_QUEUE && slot < 0; i++)
+  {
+    if (!_queue[i].used)
+      slot = (int8_t)i;
+    else if (_queue[i].waiters < 0 && _queue[i].prio == PRIO_BACKGROUND)
+      poll = (int8_t)i;
+  }
+  // full: a queued poll (nobody waiting on it) makes room for anything more important
+  if (slot < 0 && poll >= 0 && prio != PRIO_BACKGROUND)
+    slot = poll;
+  if (slot < 0)
+    return false;
+
+  QueueItem &q = _queue[slot];
+  q.used = true;
+  memcpy(q.mac, mac, 6);
+  q.type = type;
+  q.len = len;
+  if (payload && len)
+    memcpy(q.payload, payload, len);
+  q.waiters = -1;
+  if (cb)
+    addWaiter(q.waiters, std::move(cb), deadlineMs);
+  q.timeoutMs = timeoutMs;
+  q.retries = retries;
+  q.prio = prio;
+  q.enqueuedAtMs = millis();
+  return true;
+}
+
+void EspNowService::addWaiter(int8_t &head, ReplyCallback &&cb, uint32_t deadlineMs)
+{
+  // can't run out: the pool is as large as the _cbOutstanding cap checked by enqueueLocked
+  for (uint8_t i = 0; i < MAX_WAITERS; i++)
+  {
+    Waiter &w = _waiters[i];
+    if (w.used)
+      continue;
+    w.used = true;
+    w.cb = std::move(cb);
+    w.hasDeadline = deadlineMs > 0;
+    w.deadlineMs = millis() + deadlineMs;
+    w.next = head;
+    head = (int8_t)i;
+    _cbOutstanding++;
+    return;
+  }
+}
+
+void EspNowService::completeWaiters(int8_t &head, const Reply &r)
+{
+  // callbacks are run by loop() on the caller's task
+  while (head >= 0)
+  {
+    Waiter &w = _waiters[head];
+    head = w.next;
+
+    Completion c;
+    c.cb = std::move(w.cb);
+    c.r = r;
+    w = Waiter{};
+
+    if (!_done.push(std::move(c)))
+    {
+      _cbOutstanding--;
+      Serial.println("[ESPNOW] completion ring full, callback dropped");
+    }
+  }
+}
+
+bool EspNowService::expireWaiters(int8_t &head, uint32_t nowMs)
+{
+  if (head < 0)
+    return false;
+
+  Reply r;
+  r.tel.error = Error::DeadlineExceeded;
+  r.cmd.error = Error::DeadlineExceeded;
+
+  int8_t *link = &head;
+  while (*link >= 0)
+  {
+    Waiter &w = _waiters[*link];
+    if (!w.hasDeadline || (int32_t)(nowMs - w.deadlineMs) < 0)
+    {
+      link = &w.next;
+      continue;
+    }
+
+    // unlink and answer this one alone
+    int8_t one = *link;
+    *link = w.next;
+    w.next = -1;
+    completeWaiters(one, r);
+  }
+  return head < 0;
+}
+
+EspNowService::Priority EspNowService::priorityOf(uint8_t type, bool hasCaller)
+{
+  switch (type)
+  {
+  case pnow::CMD_REBOOT:
+  case pnow::CMD_RESET:
+  case pnow::CMD_TARE:
+  case pnow::CMD_WRITE:
+  case pnow::CMD_OTA:
+  case pnow::CMD_CHANNEL:
+    return PRIO_CONTROL;
+  default:
+    // STATUS/TELEMETRY: someone waiting = cloud-initiated, else a background poll
+    return hasCaller ? PRIO_INTERACTIVE : PRIO_BACKGROUND;
+  }
+}
+
+uint8_t EspNowService::effectivePriority(const QueueItem &q, uint32_t nowMs)
+{
+  // aging: one class up per PRIO_AGING_MS spent in the queue, so nothing starves
+  uint32_t steps = (nowMs - q.enqueuedAtMs) / PRIO_AGING_MS;
+  return q.prio > steps ? (uint8_t)(q.prio - steps) : (uint8_t)PRIO_CONTROL;
+}
+
+void EspNowService::processQueue()
+{
+  const uint32_t nowMs = millis();
+
+  // nobody waits for it anymore: drop instead of sending
+  for (uint8_t i = 0; i < MAX_QUEUE; i++)
+  {
+    if (_queue[i].used && expireWaiters(_queue[i].waiters, nowMs))
+      _queue[i].used = false;
+  }
+
+  // strict priority (after aging), FIFO within a class
+  for (;;)
+  {
+    int8_t slot = findFreeInFlight();
+    if (slot < 0)
+      return;
+    const uint8_t freeSlots = freeInFlightSlots();
+
+    int8_t best = -1;
+    uint8_t bestPrio = 0xFF;
+    for (uint8_t i = 0; i < MAX_QUEUE; i++)
+    {
+      const QueueItem &q = _queue[i];
+      if (!q.used)
+        continue;
+      // one request per peer: later items for a busy peer stay queued
+      if (isMacInFlight(q.mac))
+        continue;
+      // every driver slot is pinned by other requests: wait for one to finish
+      if (!canAcquireDriverSlot(q.mac))
+        continue;
+
+      // polls leave the last in-flight slots to control and interactive requests; by class,
+      // so a poll that aged up still can't take them (aging only orders the queue)
+      if (q.prio == PRIO_BACKGROUND && freeSlots <= INFLIGHT_RESERVED)
+        continue;
+      uint8_t prio = effectivePriority(q, nowMs);
+      if (best < 0 || prio < bestPrio ||
+          (prio == bestPrio && (int32_t)(q.enqueuedAtMs - _queue[best].enqueuedAtMs) < 0))
+      {
+        best = (int8_t)i;
+        bestPrio = prio;
+      }
+    }
+    if (best < 0)
+      return;
+
+    QueueItem &q = _queue[best];
+    Pending &p = _inflight[slot];
+    memcpy(p.mac, q.mac, 6);
+    p.type = q.type;
+    p.len = q.len;
+    memcpy(p.payload, q.payload, q.len);
+    p.waiters = q.waiters;
+    p.timeoutMs = rtoFor(p.mac, q.timeoutMs);
+    p.retries = q.retries;
+    p.retriesLeft = q.retries;
+    p.holdSend = false;
+    p.resetStep = 0;
+    p.resynced = false;
+    p.seq = 0;
+    p.active = true;
+    if (LinkStats *ls = linkOf(p.mac))
+      ls->requests++;
+
+    q.used = false;
+    q.waiters = -1;
+
+    bool sent = sendReq(p, true);
+    p.firstSeq = p.seq;
+    p.deadlineMs = millis() + p.timeoutMs;
+    if (!sent)
+      failPending((uint8_t)slot, Error::SendFailed);
+  }
+}
+
+bool EspNowService::isMacInFlight(const uint8_t mac[6]) const
+{
+  for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+  {
+    if (_inflight[i].active && memcmp(_inflight[i].mac, mac, 6) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool EspNowService::isMacQueued(const uint8_t mac[6]) const
+{
+  for (uint8_t i = 0; i < MAX_QUEUE; i++)
+  {
+    if (_queue[i].used && memcmp(_queue[i].mac, mac, 6) == 0)
+      return true;
+  }
+  return false;
+}
+
+uint8_t EspNowService::freeQueueSlots() const
+{
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < MAX_QUEUE; i++)
+    if (!_queue[i].used)
+      n++;
+  return n;
+}
+
+uint8_t EspNowService::freeInFlightSlots() const
+{
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+    if (!_inflight[i].active)
+      n++;
+  return n;
+}
+
+int8_t EspNowService::findFreeInFlight() const
+{
+  for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+  {
+    if (!_inflight[i].active)
+      return (int8_t)i;
+  }
+  return -1;
+}
+
+bool EspNowService::isIdempotent(uint8_t type)
+{
+  return type == pnow::CMD_STATUS || type == pnow::CMD_TELEMETRY;
+}
 
-struct TelemetryResp
+uint32_t EspNowService::nextSeq(const uint8_t mac[6])
 {
-  uint8_t type; // 2
-  uint8_t corr[16];
-  uint8_t ok;
-  int32_t weight;
-  uint16_t variance;
-  uint32_t tagAtMs;
-  uint32_t weightAtMs;
-  char uid[16];
-};
-#pragma pack(pop)
+  uint32_t seq;
+  int32_t slot = findIndexSlot(mac);
+  if (slot >= 0)
+  {
+    PeerState &st = _state[_index[slot] - 1];
+    // a peer (re)added this boot continues above everything sent so far
+    if (st.txSeq == 0)
+      st.txSeq = _seqHigh;
+    seq = ++st.txSeq;
+  }
+  else
+  {
+    seq = _seqHigh + 1;
+  }
+  _seqHigh = max(_seqHigh, seq);
 
-EspNowService::EspNowService() {}
+  if (seq > _seqCeiling)
+  {
+    // once per SEQ_RESERVE frames: persisted before the seq goes on air
+    _seqCeiling = seq + SEQ_RESERVE;
+    if (!_prefs.setPnowGwSeqCeiling(_seqCeiling))
+      Serial.println("[ESPNOW] failed to persist seq ceiling");
+  }
+  return seq;
+}
 
-bool EspNowService::begin()
+bool EspNowService::sendReq(Pending &p, bool newSeq)
 {
-  // ESPNOW needs STA or AP_STA (never WIFI_OFF)
-  wifi_mode_t mode = WiFi.getMode();
-  if (mode == WIFI_OFF)
-    WiFi.mode(WIFI_STA);
-  else if (mode == WIFI_AP)
-    WiFi.mode(WIFI_AP_STA);
+  if (newSeq || p.seq == 0)
+  {
+    p.seq = nextSeq(p.mac);
+    p.retransmitted = false;
+  }
+  else
+  {
+    p.retransmitted = true;
+  }
+  p.sentAtMs = millis();
 
-  if (esp_now_init() != ESP_OK)
+  if (!acquireDriverSlot(p.mac))
     return false;
 
-  _self = this;
-  esp_now_register_recv_cb(&EspNowService::recvStatic);
+  uint8_t frame[pnow::PN_MAX_FRAME];
+  size_t n = pnow::build_frame(frame, sizeof(frame), p.type, p.seq, p.payload, p.len);
+  if (n == 0)
+    return false;
+
+  if (!_tx.send(p.mac, frame, n))
+    return false;
+  int8_t ds = findDriverSlot(p.mac);
+  if (ds >= 0)
+    _driver[ds].txQueued++;
   return true;
 }
 
-void EspNowService::loop()
+void EspNowService::txResultStatic(void *ctx, const uint8_t mac[6], bool delivered)
+{
+  static_cast<EspNowService *>(ctx)->onTxResult(mac, delivered);
+}
+
+void EspNowService::onTxResult(const uint8_t mac[6], bool delivered)
 {
-  if (_pending.active && (int32_t)(millis() - _pending.deadlineMs) > 0)
+  // TX task
+  bool wake = false;
   {
-    if (_pending.retriesLeft > 0)
+    EngineLock lock(_mtx);
+    int8_t ds = findDriverSlot(mac);
+    if (ds >= 0 && _driver[ds].txQueued > 0)
     {
-      _pending.retriesLeft--;
-      sendReq(_pending.mac);
-      _pending.deadlineMs = millis() + _pending.timeoutMs;
+      _driver[ds].txQueued--;
+      // unpinned: requests waiting for a driver slot (or a stale entry to re-add) can go now
+      if (_driver[ds].txQueued == 0)
+        wake = true;
     }
-    else
+
+    int32_t slot = findIndexSlot(mac);
+    if (slot >= 0)
+    {
+      LinkStats &ls = _state[_index[slot] - 1].link;
+      if (delivered)
+        ls.delivered++;
+      else
+        ls.failed++;
+    }
+
+    if (!delivered)
     {
-      failPending();
+      // the peer never got the frame: no reply is coming, retry (or fail) now
+      for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+      {
+        Pending &p = _inflight[i];
+        if (p.active && !p.holdSend && memcmp(p.mac, mac, 6) == 0)
+        {
+          p.deadlineMs = millis();
+          wake = true;
+        }
+      }
     }
   }
+  if (wake)
+    wakeEngine();
+}
+
+bool EspNowService::getLinkStats(const uint8_t mac[6], LinkStats &out) const
+{
+  EngineLock lock(_mtx);
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return false;
+  const PeerState &st = _state[_index[slot] - 1];
+  out = st.link;
+  out.srttMs = st.hasRtt ? st.srtt8 >> 3 : 0;
+  out.rssiLast = st.rssi;
+  out.rssiAvg = (int8_t)(st.rssiAvg8 / 8);
+  return true;
+}
+
+uint32_t EspNowService::rttBucketLimitMs(uint8_t i)
+{
+  static const uint32_t limits[RTT_BUCKETS] = {10, 20, 50, 100, 200, 500, 1000, UINT32_MAX};
+  return i < RTT_BUCKETS ? limits[i] : UINT32_MAX;
+}
 
-  if (!_pending.active)
-    processQueue();
+EspNowService::LinkStats *EspNowService::linkOf(const uint8_t mac[6])
+{
+  int32_t slot = findIndexSlot(mac);
+  return slot < 0 ? nullptr : &_state[_index[slot] - 1].link;
 }
 
-void EspNowService::upsertPeer(const Peer &p)
+void EspNowService::completePending(uint8_t slot, const Reply &r)
 {
-  for (uint8_t i = 0; i < _peerCount; i++)
+  Pending &p = _inflight[slot];
+  if (!p.active)
+    return;
+
+  p.active = false;
+  completeWaiters(p.waiters, r);
+
+  const Error e = r.tel.error != Error::None ? r.tel.error : r.cmd.error;
+  if (e == Error::Timeout)
   {
-    if (memcmp(_peers[i].mac, p.mac, 6) == 0)
-    {
-      _peers[i] = p;
-      return;
-    }
+    if (LinkStats *ls = linkOf(p.mac))
+      ls->timeouts++;
+    // silent and now unanswered too: it really is gone
+    int32_t s = findIndexSlot(p.mac);
+    if (s >= 0 && _state[_index[s] - 1].confirming)
+      goOffline(_index[s] - 1);
+  }
+  breakerRecord(p.mac, e);
+}
+
+void EspNowService::setBreaker(uint8_t threshold, uint32_t openMs)
+{
+  EngineLock lock(_mtx);
+  _breakerThreshold = threshold;
+  _breakerOpenMs = openMs;
+}
+
+bool EspNowService::breakerAdmits(const uint8_t mac[6], uint32_t nowMs)
+{
+  if (_breakerThreshold == 0)
+    return true;
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return true;
+
+  PeerState &st = _state[_index[slot] - 1];
+  switch (st.breaker)
+  {
+  case BREAKER_OPEN:
+    if (nowMs - st.breakerOpenedMs < _breakerOpenMs)
+      return false;
+    // this request is the trial
+    st.breaker = BREAKER_HALF_OPEN;
+    Serial.printf("[ESPNOW] %s breaker half-open\n", macToString(mac).c_str());
+    return true;
+
+  case BREAKER_HALF_OPEN:
+    // only the trial; others are answered until it succeeds
+    return !isMacInFlight(mac) && !isMacQueued(mac);
+
+  default:
+    return true;
+  }
+}
+
+void EspNowService::breakerRecord(const uint8_t mac[6], Error e)
+{
+  // no verdict: never sent, or the caller gave up
+  if (e == Error::SendFailed || e == Error::DeadlineExceeded || e == Error::ProbeOffline ||
+      e == Error::PeerRemoved)
+    return;
+
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return;
+  PeerState &st = _state[_index[slot] - 1];
+
+  if (e != Error::Timeout)
+  {
+    // any answer (even a rejection) means the probe is there
+    if (st.breaker != BREAKER_CLOSED)
+      Serial.printf("[ESPNOW] %s breaker closed\n", macToString(mac).c_str());
+    st.breaker = BREAKER_CLOSED;
+    st.timeouts = 0;
+    return;
   }
-  if (_peerCount < MAX_PEERS)
+
+  if (st.timeouts < 0xFF)
+    st.timeouts++;
+  if (_breakerThreshold == 0 || st.breaker == BREAKER_OPEN)
+    return;
+  if (st.breaker == BREAKER_HALF_OPEN || st.timeouts >= _breakerThreshold)
   {
-    _peers[_peerCount++] = p;
+    st.breaker = BREAKER_OPEN;
+    st.breakerOpenedMs = millis();
+    Serial.printf("[ESPNOW] %s breaker open (%u timeouts)\n", macToString(mac).c_str(), st.timeouts);
+    failQueued(mac, Error::ProbeOffline);
   }
 }
 
-bool EspNowService::requestTelemetryByMac(const uint8_t mac[6],
-                                          const String &correlationIdHex,
-                                          TelemetryCallback cb,
-                                          uint32_t timeoutMs,
-                                          uint8_t retries)
+void EspNowService::failQueued(const uint8_t mac[6], Error e)
 {
+  Reply r;
+  r.tel.error = e;
+  r.cmd.error = e;
   for (uint8_t i = 0; i < MAX_QUEUE; i++)
   {
-    if (!_queue[i].used)
+    QueueItem &q = _queue[i];
+    if (q.used && memcmp(q.mac, mac, 6) == 0)
     {
-      _queue[i].used = true;
-      memcpy(_queue[i].mac, mac, 6);
-      if (!hexTo16(correlationIdHex, _queue[i].corr))
-      {
-        _queue[i].used = false;
-        return false;
-      }
-      _queue[i].cb = cb;
-      _queue[i].timeoutMs = timeoutMs;
-      _queue[i].retries = retries;
-      return true;
+      completeWaiters(q.waiters, r);
+      q.used = false;
     }
   }
-  return false;
+
+  // a confirmation poll dropped because the breaker opened: its timeouts already answer it
+  int32_t slot = findIndexSlot(mac);
+  if (e == Error::ProbeOffline && slot >= 0 && _state[_index[slot] - 1].confirming)
+    goOffline(_index[slot] - 1);
 }
 
-void EspNowService::processQueue()
+void EspNowService::failPending(uint8_t slot, Error e, uint8_t probeErr)
 {
-  for (uint8_t i = 0; i < MAX_QUEUE; i++)
+  Reply r;
+  r.tel.error = e;
+  r.cmd.error = e;
+  r.cmd.probeErr = probeErr;
+  completePending(slot, r);
+}
+
+void EspNowService::sniffStatic(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+  // WiFi task: keep the RSSI of ESP-NOW frames (action frame, vendor category, Espressif OUI)
+  if (!_self || type != WIFI_PKT_MGMT)
+    return;
+  const wifi_promiscuous_pkt_t *pkt = (const wifi_promiscuous_pkt_t *)buf;
+  const uint8_t *p = pkt->payload;
+  if (pkt->rx_ctrl.sig_len < 28 || p[0] != 0xD0 || p[24] != 127 || p[25] != 0x18 || p[26] != 0xFE || p[27] != 0x34)
+    return;
+  memcpy(_self->_sniffMac, p + 10, 6);
+  _self->_sniffRssi = (int8_t)pkt->rx_ctrl.rssi;
+}
+
+void EspNowService::recvStatic(const uint8_t *mac, const uint8_t *data, int len)
+{
+  // WiFi task: copy and hand off, nothing else
+  if (!_self || len <= 0 || len > ESP_NOW_MAX_DATA_LEN)
+    return;
+
+  RxFrame *f = _self->_rx.beginPush();
+  if (!f)
+    return;
+  memcpy(f->mac, mac, 6);
+  f->rssi = memcmp(mac, _self->_sniffMac, 6) == 0 ? _self->_sniffRssi : 0;
+  f->len = (uint8_t)len;
+  memcpy(f->data, data, len);
+  _self->_rx.commitPush();
+
+  _self->wakeEngine();
+}
+
+void EspNowService::onRecv(const uint8_t *mac, const uint8_t *data, int len)
+{
+  pnow::Header h{};
+  const uint8_t *payload = nullptr;
+  if (!pnow::validate_basic(data, len, h, payload))
+    return; // not a pnow frame (raw heartbeat) or corrupted
+
+  if (h.type == pnow::EVT_PING)
   {
-    if (_queue[i].used)
-    {
-      memcpy(_pending.mac, _queue[i].mac, 6);
-      memcpy(_pending.corr, _queue[i].corr, 16);
-      _pending.cb = _queue[i].cb;
-      _pending.timeoutMs = _queue[i].timeoutMs;
-      _pending.retriesLeft = _queue[i].retries;
-      _pending.deadlineMs = millis() + _pending.timeoutMs;
-      _pending.active = true;
+    answerPing(mac, h.seq);
+    return;
+  }
+  announceChannelTo(mac);
 
-      _queue[i].used = false;
+  if (h.type == pnow::EVT_TELEMETRY)
+  {
+    onPush(mac, h, payload);
+    return;
+  }
+
+  for (uint8_t i = 0; i < MAX_INFLIGHT; i++)
+  {
+    const Pending &p = _inflight[i];
+    if (!p.active || memcmp(mac, p.mac, 6) != 0)
+      continue;
 
-      sendReq(_pending.mac);
+    // replies echo the seq they answer; a re-sequenced request accepts any of its seqs
+    if (h.seq < p.firstSeq || h.seq > p.seq)
       return;
-    }
+
+    if (LinkStats *ls = linkOf(mac))
+      ls->responses++;
+    if (h.seq == p.seq && !p.retransmitted)
+      sampleRtt(mac, millis() - p.sentAtMs);
+    onResponse(i, h, payload);
+    return;
   }
 }
 
-bool EspNowService::sendReq(const uint8_t mac[6])
+void EspNowService::onPush(const uint8_t mac[6], const pnow::Header &h, const uint8_t *payload)
 {
-  if (!addPeerIfNeeded(mac))
-    return false;
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0 || h.len < sizeof(pnow::TelemetryPayload))
+    return;
+  PeerState &st = _state[_index[slot] - 1];
+
+  // MAC-level resends deliver the same push twice
+  if (st.pushes && st.pushSeq - h.seq < PUSH_SEQ_WINDOW)
+    return;
+  const bool firstPush = !st.pushes;
+  st.pushes = true;
+  st.pushSeq = h.seq;
 
-  TelemetryReq req{};
-  req.type = 1;
-  memcpy(req.corr, _pending.corr, 16);
+  pnow::TelemetryPayload t{};
+  memcpy(&t, payload, sizeof(t));
+  const uint8_t changes = pnow::tel_change_count(t.reason);
+  const bool changed = firstPush || changes != st.pushChanges;
+  st.pushChanges = changes;
+  if (!t.ok)
+    return;
 
-  return esp_now_send(mac, (uint8_t *)&req, sizeof(req)) == ESP_OK;
+  PushEvent e{};
+  fromPayload(t, e.r);
+  storeSnapshot(mac, e.r);
+  if (!changed)
+    return;
+  memcpy(e.mac, mac, 6);
+  _pushes.push(std::move(e));
 }
 
-void EspNowService::failPending()
+void EspNowService::answerPing(const uint8_t mac[6], uint32_t seq)
 {
-  if (!_pending.active)
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0 || _channel == 0)
+    return;
+  _state[_index[slot] - 1].announceChannel = false; // the ack tells it
+
+  // fire and forget: a lost ack only costs the probe one more ping
+  if (!acquireDriverSlot(mac))
     return;
-  TelemetryResponse r{};
-  r.ok = false;
-  if (_pending.cb)
-    _pending.cb(r);
-  _pending.active = false;
+  pnow::AckPayload a{};
+  a.ok = 1;
+  a.arg = _channel;
+  uint8_t frame[sizeof(pnow::Header) + sizeof(a)];
+  size_t n = pnow::build_frame(frame, sizeof(frame), pnow::RSP_ACK, seq, &a, sizeof(a));
+  if (n == 0 || !_tx.send(mac, frame, n))
+    return;
+  int8_t ds = findDriverSlot(mac);
+  if (ds >= 0)
+    _driver[ds].txQueued++;
 }
 
-void EspNowService::recvStatic(const uint8_t *mac, const uint8_t *data, int len)
+void EspNowService::announceChannelTo(const uint8_t mac[6])
 {
-  if (_self)
-    _self->onRecv(mac, data, len);
+  int32_t slot = findIndexSlot(mac);
+  if (slot < 0)
+    return;
+  PeerState &st = _state[_index[slot] - 1];
+  if (!st.announceChannel)
+    return;
+
+  pnow::ChannelPayload cp{};
+  cp.channel = _channel;
+  if (enqueueLocked(mac, pnow::CMD_CHANNEL, (const uint8_t *)&cp, sizeof(cp), nullptr, _pollTimeoutMs, 1, 0))
+    st.announceChannel = false;
 }
-void EspNowService::onRecv(const uint8_t *mac, const uint8_t *data, int len)
+
+void EspNowService::checkChannel()
 {
-  if (!_pending.active)
-    return;
-  if (memcmp(mac, _pending.mac, 6) != 0)
+  // caller's task; the channel moves when the AP does (or WiFi reconnects to another AP)
+  const uint32_t nowMs = millis();
+  if (nowMs - _lastChannelCheckMs < CHANNEL_CHECK_MS)
     return;
-  if (len < (int)sizeof(TelemetryResp))
+  _lastChannelCheckMs = nowMs;
+
+  // unassociated, the radio sits on whatever channel it started on: not ours yet
+  if (WiFi.status() != WL_CONNECTED)
     return;
 
-  const auto *resp = (const TelemetryResp *)data;
-  if (resp->type != 2)
+  uint8_t primary = 0;
+  wifi_second_chan_t second;
+  if (esp_wifi_get_channel(&primary, &second) != ESP_OK || !pnow::channel_valid(primary))
     return;
-  if (memcmp(resp->corr, _pending.corr, 16) != 0)
+
+  EngineLock lock(_mtx);
+  if (primary == _channel)
     return;
+  // the first channel after boot is just recorded; only a later move is news to the probes
+  if (_channel != 0)
+  {
+    Serial.printf("[ESPNOW] channel %u -> %u, announcing to peers\n", _channel, primary);
+    for (uint16_t i = 0; i < _peerCount; i++)
+      _state[i].announceChannel = true;
+  }
+  _channel = primary;
+}
 
-  TelemetryResponse r{};
-  r.ok = resp->ok != 0;
-  r.weight = resp->weight;
-  r.variance = resp->variance;
-  r.tagAtMs = resp->tagAtMs;
-  r.weightAtMs = resp->weightAtMs;
-  r.uid = String(resp->uid);
+void EspNowService::fromPayload(const pnow::TelemetryPayload &t, TelemetryResponse &out)
+{
+  char uid[sizeof(t.uid) + 1];
+  memcpy(uid, t.uid, sizeof(t.uid));
+  uid[sizeof(t.uid)] = '\0';
 
-  if (_pending.cb)
-    _pending.cb(r);
-  _pending.active = false;
+  out.ok = true;
+  out.weight = t.weight_g;
+  out.variance = t.variance;
+  out.tagAtMs = t.tag_at_ms;
+  out.weightAtMs = t.weight_at_ms;
+  out.uid = String(uid);
 }
 
-bool EspNowService::findPeer(const uint8_t mac[6], Peer &out)
+void EspNowService::onResponse(uint8_t slot, const pnow::Header &h, const uint8_t *payload)
 {
-  for (uint8_t i = 0; i < _peerCount; i++)
+  Pending &p = _inflight[slot];
+  Reply r;
+
+  switch (h.type)
+  {
+  case pnow::RSP_ACK:
   {
-    if (memcmp(_peers[i].mac, mac, 6) == 0)
+    if (h.len < sizeof(pnow::AckPayload))
+      return;
+    pnow::AckPayload a{};
+    memcpy(&a, payload, sizeof(a));
+
+    bool replayed = false;
+    if (!a.ok)
     {
-      out = _peers[i];
-      return true;
+      if ((a.err == pnow::ERR_RATE_LIMIT || a.err == pnow::ERR_BUSY) && p.retriesLeft > 0)
+      {
+        // not run (out of tokens, or the probe is reserving seqs): send again once it can
+        uint32_t waitMs = a.err == pnow::ERR_RATE_LIMIT ? pnow::rate_limit_wait_ms(a.arg) : 0;
+        if (waitMs == 0)
+          waitMs = PROBE_CMD_SPACING_MS;
+        else if (waitMs + 5 < PROBE_MAX_HOLD_MS)
+          waitMs += 5;
+        else
+          waitMs = PROBE_MAX_HOLD_MS;
+        p.retriesLeft--;
+        p.holdSend = true;
+        p.deadlineMs = millis() + waitMs;
+        return;
+      }
+      // below the probe's boot floor (it restarted): it refuses every seq up to arg from now
+      // on, so move past it even if this request ends here, or the next one bounces too
+      const bool belowFloor = a.err == pnow::ERR_REPLAY && (a.flags & pnow::ACK_SEQ_FLOOR) != 0;
+      if (belowFloor)
+        resyncSeq(p.mac, a.arg);
+
+      // the probe has already seen this seq: our first copy got through, its ACK was lost.
+      // A retransmit below the floor may have run before the probe restarted (e.g. CMD_REBOOT),
+      // so at-most-once wins
+      replayed = a.err == pnow::ERR_REPLAY && p.retransmitted && (belowFloor || a.arg >= p.seq);
+      if (a.err == pnow::ERR_REPLAY && !replayed && !p.resynced)
+      {
+        // a first copy the probe refused never ran (below its boot floor, or our seqs fell
+        // behind its window): continue above its mark, once per request
+        resyncSeq(p.mac, a.arg);
+        p.resynced = true;
+        p.holdSend = true;
+        p.deadlineMs = millis();
+        return;
+      }
+      if (!replayed)
+      {
+        failPending(slot, Error::Rejected, a.err);
+        return;
+      }
+    }
+
+    if (p.type == pnow::CMD_RESET && p.resetStep == 0)
+    {
+      pnow::ResetPayload rp{};
+      memcpy(&rp, p.payload, sizeof(rp));
+      if (!replayed && a.arg != rp.nonce)
+      {
+        failPending(slot, Error::Rejected, pnow::ERR_INVALID_STATE);
+        return;
+      }
+      // armed: confirm with the same nonce (new seq, after the probe's command spacing)
+      p.resetStep = 1;
+      p.retriesLeft = p.retries;
+      p.firstSeq = p.seq + 1;
+      p.holdSend = true;
+      p.deadlineMs = millis() + PROBE_CMD_SPACING_MS;
+      return;
+    }
+
+    if (p.type == pnow::CMD_TELEMETRY)
+    {
+      // probe firmware that only ACKs telemetry requests
+      failPending(slot, Error::NoData);
+      return;
     }
+
+    r.cmd.ok = true;
+    r.cmd.arg = replayed ? 0 : a.arg;
+    completePending(slot, r);
+    return;
   }
-  return false;
+
+  case pnow::RSP_STATUS:
+  {
+    if (p.type != pnow::CMD_STATUS || h.len < sizeof(pnow::StatusPayload))
+      return;
+    pnow::StatusPayload st{};
+    memcpy(&st, payload, sizeof(st));
+
+    r.cmd.ok = true;
+    r.cmd.hasStatus = true;
+    r.cmd.uptimeS = st.uptime_s;
+    r.cmd.lastWeight = st.last_weight_g;
+    r.cmd.statusFlags = st.flags;
+    completePending(slot, r);
+    return;
+  }
+
+  case pnow::RSP_TELEMETRY:
+  {
+    if (p.type != pnow::CMD_TELEMETRY || h.len < sizeof(pnow::TelemetryPayload))
+      return;
+    pnow::TelemetryPayload t{};
+    memcpy(&t, payload, sizeof(t));
+    if (!t.ok)
+    {
+      failPending(slot, Error::NoData);
+      return;
+    }
+
+    fromPayload(t, r.tel);
+    storeSnapshot(p.mac, r.tel);
+    completePending(slot, r);
+    return;
+  }
+
+  default:
+    return;
+  }
+}
+
+// -------------------- Driver peer slots (LRU) --------------------
+int8_t EspNowService::findDriverSlot(const uint8_t mac[6]) const
+{
+  for (uint8_t i = 0; i < DRIVER_SLOTS; i++)
+  {
+    if (_driver[i].used && memcmp(_driver[i].mac, mac, 6) == 0)
+      return (int8_t)i;
+  }
+  return -1;
+}
+
+uint8_t EspNowService::driverPeerCount() const
+{
+  EngineLock lock(_mtx);
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < DRIVER_SLOTS; i++)
+    if (_driver[i].used)
+      n++;
+  return n;
+}
+
+int8_t EspNowService::lruVictim(bool encryptedOnly) const
+{
+  int8_t victim = -1;
+  for (uint8_t i = 0; i < DRIVER_SLOTS; i++)
+  {
+    const DriverSlot &d = _driver[i];
+    if (!d.used || (encryptedOnly && !d.encrypted))
+      continue;
+    // a reply from an encrypted peer can't be decrypted once it is gone from the driver
+    if (driverPinned((int8_t)i) || d.resident)
+      continue;
+    if (victim < 0 || (int32_t)(d.lastUse - _driver[victim].lastUse) < 0)
+      victim = (int8_t)i;
+  }
+  return victim;
+}
+
+bool EspNowService::driverPinned(int8_t i) const
+{
+  return _driver[i].txQueued > 0 || isMacInFlight(_driver[i].mac);
+}
+
+void EspNowService::releaseStaleDriverSlots()
+{
+  for (uint8_t i = 0; i < DRIVER_SLOTS; i++)
+  {
+    if (_driver[i].used && _driver[i].stale && !driverPinned((int8_t)i))
+      releaseDriverSlot((int8_t)i);
+  }
+}
+
+void EspNowService::keepResident(const uint8_t mac[6])
+{
+  // only encrypted peers need it (unencrypted frames are received without a driver entry)
+  int8_t ds = findDriverSlot(mac);
+  if (ds < 0 || !_driver[ds].encrypted || _driver[ds].resident || _driver[ds].stale)
+    return;
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < DRIVER_SLOTS; i++)
+    if (_driver[i].used && _driver[i].resident)
+      n++;
+  if (n < DRIVER_RESIDENT_MAX)
+    _driver[ds].resident = true;
+}
+
+bool EspNowService::canAcquireDriverSlot(const uint8_t mac[6]) const
+{
+  int8_t ds = findDriverSlot(mac);
+  if (ds >= 0)
+    return !_driver[ds].stale; // re-added with the new key once it is released
+
+  const Peer *p = findPeer(mac);
+  const bool encrypt = p && p->hasLmk;
+  uint8_t used = 0, encrypted = 0;
+  for (uint8_t i = 0; i < DRIVER_SLOTS; i++)
+  {
+    if (!_driver[i].used)
+      continue;
+    used++;
+    if (_driver[i].encrypted)
+      encrypted++;
+  }
+
+  if (encrypt && encrypted >= DRIVER_ENCRYPT_SLOTS)
+    return lruVictim(true) >= 0;
+  if (used >= DRIVER_SLOTS)
+    return lruVictim(false) >= 0;
+  return true;
 }
 
-bool EspNowService::addPeerIfNeeded(const uint8_t mac[6])
+bool EspNowService::acquireDriverSlot(const uint8_t mac[6])
 {
-  if (esp_now_is_peer_exist(mac))
+  int8_t ds = findDriverSlot(mac);
+  if (ds >= 0 && _driver[ds].stale && !driverPinned(ds))
+  {
+    releaseDriverSlot(ds);
+  }
+  else if (ds >= 0)
+  {
+    // a stale slot still pinned keeps serving the request it is pinned by (old key);
+    // new requests wait for it in the queue (canAcquireDriverSlot)
+    _driver[ds].lastUse = ++_driverTick;
     return true;
+  }
+
+  const Peer *p = findPeer(mac);
+  const bool encrypt = p && p->hasLmk;
+
+  uint8_t used = 0, encrypted = 0;
+  int8_t freeSlot = -1;
+  for (uint8_t i = 0; i < DRIVER_SLOTS; i++)
+  {
+    if (!_driver[i].used)
+    {
+      if (freeSlot < 0)
+        freeSlot = (int8_t)i;
+      continue;
+    }
+    used++;
+    if (_driver[i].encrypted)
+      encrypted++;
+  }
 
-  Peer p{};
-  bool has = findPeer(mac, p);
+  // make room: an encrypted peer needs an encrypted slot, anything needs a slot
+  int8_t victim = -1;
+  if (encrypt && encrypted >= DRIVER_ENCRYPT_SLOTS)
+    victim = lruVictim(true);
+  else if (used >= DRIVER_SLOTS)
+    victim = lruVictim(false);
+  if (victim >= 0)
+  {
+    releaseDriverSlot(victim);
+    _driverEvictions++;
+    freeSlot = victim;
+  }
+  else if ((encrypt && encrypted >= DRIVER_ENCRYPT_SLOTS) || freeSlot < 0)
+  {
+    return false;
+  }
 
   esp_now_peer_info_t info{};
   memcpy(info.peer_addr, mac, 6);
   info.channel = 0; // current channel
   info.encrypt = false;
 
-  if (has && p.hasLmk)
+  if (encrypt)
   {
     info.encrypt = true;
-    memcpy(info.lmk, p.lmk, 16);
+    memcpy(info.lmk, p->lmk, 16);
   }
 
-  return esp_now_add_peer(&info) == ESP_OK;
+  if (esp_now_add_peer(&info) != ESP_OK)
+    return false;
+
+  DriverSlot &d = _driver[freeSlot];
+  d.used = true;
+  memcpy(d.mac, mac, 6);
+  d.encrypted = encrypt;
+  d.txQueued = 0;
+  d.lastUse = ++_driverTick;
+  return true;
+}
+
+void EspNowService::releaseDriverSlot(int8_t i)
+{
+  DriverSlot &d = _driver[i];
+  if (esp_now_is_peer_exist(d.mac))
+    esp_now_del_peer(d.mac);
+  d = DriverSlot{};
 }
 
 bool EspNowService::parseMac(const String &s, uint8_t out[6])
@@ -226,6 +1835,13 @@ bool EspNowService::parseMac(const String &s, uint8_t out[6])
   return true;
 }
 
+String EspNowService::macToString(const uint8_t mac[6])
+{
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return String(buf);
+}
+
 bool EspNowService::hexTo16(const String &hex, uint8_t out[16])
 {
   if (hex.length() != 32)
@@ -236,3 +1852,56 @@ bool EspNowService::hexTo16(const String &hex, uint8_t out[16])
   }
   return true;
 }
+
+const char *EspNowService::errorName(Error e)
+{
+  switch (e)
+  {
+  case Error::None:
+    return "none";
+  case Error::Timeout:
+    return "timeout";
+  case Error::Rejected:
+    return "rejected";
+  case Error::NoData:
+    return "no_data";
+  case Error::SendFailed:
+    return "send_failed";
+  case Error::DeadlineExceeded:
+    return "deadline_exceeded";
+  case Error::ProbeOffline:
+    return "probe_offline";
+  case Error::PeerRemoved:
+    return "peer_removed";
+  }
+  return "unknown";
+}
+
+const char *EspNowService::probeErrName(uint8_t err)
+{
+  switch (err)
+  {
+  case pnow::ERR_OK:
+    return "ok";
+  case pnow::ERR_BAD_VERSION:
+    return "bad_version";
+  case pnow::ERR_BAD_LEN:
+    return "bad_len";
+  case pnow::ERR_BAD_CRC:
+    return "bad_crc";
+  case pnow::ERR_REPLAY:
+    return "replay";
+  case pnow::ERR_RATE_LIMIT:
+    return "rate_limit";
+  case pnow::ERR_NOT_SUPPORTED:
+    return "not_supported";
+  case pnow::ERR_BUSY:
+    return "busy";
+  case pnow::ERR_INVALID_STATE:
+    return "invalid_state";
+  case pnow::ERR_TIMEOUT:
+    return "timeout";
+  default:
+    return "unknown";
+  }
+}
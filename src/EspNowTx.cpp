@@ -0,0 +1,196 @@
+#include "EspNowTx.h"
+
+EspNowTx *EspNowTx::_self = nullptr;
+
+bool EspNowTx::begin(ResultHook hook, void *ctx)
+{
+  if (!_mtx)
+    _mtx = xSemaphoreCreateMutex();
+  if (!_mtx)
+    return false;
+
+  if (!_task && xTaskCreatePinnedToCore(&EspNowTx::taskStatic, "espnow_tx", TASK_STACK, this, TASK_PRIO, &_task, TASK_CORE) != pdPASS)
+  {
+    _task = nullptr;
+    Serial.println("[ESPNOW] tx task create failed");
+    return false;
+  }
+
+  xSemaphoreTake(_mtx, portMAX_DELAY);
+  _hook = hook;
+  _hookCtx = ctx;
+  _head = 0;
+  _count = 0;
+  _inFlight = false;
+  _cbStatus.store(CB_NONE);
+  _started = true;
+  xSemaphoreGive(_mtx);
+
+  _self = this;
+  return esp_now_register_send_cb(&EspNowTx::sentStatic) == ESP_OK;
+}
+
+void EspNowTx::end()
+{
+  if (!_mtx)
+    return;
+  esp_now_unregister_send_cb();
+
+  // queued frames never go out: report them as failed, so the owner's per-frame state unwinds
+  uint8_t macs[QUEUE_SIZE][6];
+  uint8_t n;
+  xSemaphoreTake(_mtx, portMAX_DELAY);
+  _started = false;
+  n = _count;
+  for (uint8_t i = 0; i < n; i++)
+    memcpy(macs[i], _q[(_head + i) % QUEUE_SIZE].mac, 6);
+  _count = 0;
+  _inFlight = false;
+  xSemaphoreGive(_mtx);
+
+  if (_hook)
+  {
+    for (uint8_t i = 0; i < n; i++)
+      _hook(_hookCtx, macs[i], false);
+  }
+}
+
+bool EspNowTx::send(const uint8_t mac[6], const uint8_t *data, size_t len)
+{
+  if (!_mtx || len == 0 || len > ESP_NOW_MAX_DATA_LEN)
+    return false;
+
+  xSemaphoreTake(_mtx, portMAX_DELAY);
+  if (!_started || _count >= QUEUE_SIZE)
+  {
+    if (_started)
+      _stats.dropped++;
+    xSemaphoreGive(_mtx);
+    return false;
+  }
+
+  Frame &f = _q[(_head + _count) % QUEUE_SIZE];
+  memcpy(f.mac, mac, 6);
+  f.len = (uint8_t)len;
+  f.attempts = 0;
+  memcpy(f.data, data, len);
+  _count++;
+  xSemaphoreGive(_mtx);
+
+  xTaskNotifyGive(_task);
+  return true;
+}
+
+EspNowTx::Stats EspNowTx::stats() const
+{
+  if (!_mtx)
+    return _stats;
+  xSemaphoreTake(_mtx, portMAX_DELAY);
+  Stats s = _stats;
+  xSemaphoreGive(_mtx);
+  return s;
+}
+
+uint8_t EspNowTx::queued() const
+{
+  return _count;
+}
+
+void EspNowTx::sentStatic(const uint8_t *mac, esp_now_send_status_t status)
+{
+  // WiFi task: record and hand off
+  if (!_self)
+    return;
+  _self->_cbStatus.store(status == ESP_NOW_SEND_SUCCESS ? CB_OK : CB_FAIL);
+  xTaskNotifyGive(_self->_task);
+}
+
+void EspNowTx::taskStatic(void *arg)
+{
+  static_cast<EspNowTx *>(arg)->taskLoop();
+}
+
+void EspNowTx::taskLoop()
+{
+  for (;;)
+  {
+    // woken by send() or the send callback
+    ulTaskNotifyTake(pdTRUE, _inFlight ? pdMS_TO_TICKS(CB_TIMEOUT_MS) : portMAX_DELAY);
+
+    if (_inFlight)
+    {
+      uint8_t st = _cbStatus.exchange(CB_NONE);
+      if (st == CB_NONE && millis() - _sentAtMs < CB_TIMEOUT_MS)
+        continue;
+      _inFlight = false;
+      finishHead(st == CB_OK);
+    }
+
+    pump();
+  }
+}
+
+void EspNowTx::pump()
+{
+  Frame f;
+  while (!_inFlight)
+  {
+    // sent from a copy: end() may drop the queue while the driver has the frame
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    if (_count == 0)
+    {
+      xSemaphoreGive(_mtx);
+      return;
+    }
+    _q[_head].attempts++;
+    f = _q[_head];
+    xSemaphoreGive(_mtx);
+
+    _cbStatus.store(CB_NONE);
+    if (esp_now_send(f.mac, f.data, f.len) == ESP_OK)
+    {
+      _inFlight = true;
+      _sentAtMs = millis();
+      xSemaphoreTake(_mtx, portMAX_DELAY);
+      _stats.sent++;
+      xSemaphoreGive(_mtx);
+      return;
+    }
+
+    // refused by the driver (unknown peer, out of buffers): counts as a failed attempt
+    finishHead(false);
+    vTaskDelay(1);
+  }
+}
+
+void EspNowTx::finishHead(bool delivered)
+{
+  uint8_t mac[6];
+
+  xSemaphoreTake(_mtx, portMAX_DELAY);
+  if (_count == 0)
+  {
+    xSemaphoreGive(_mtx);
+    return;
+  }
+  Frame &f = _q[_head];
+  if (!delivered && f.attempts <= MAC_RETRIES)
+  {
+    // stays at the head: pump() sends it again right away
+    _stats.retries++;
+    xSemaphoreGive(_mtx);
+    return;
+  }
+
+  memcpy(mac, f.mac, 6);
+  if (delivered)
+    _stats.delivered++;
+  else
+    _stats.failed++;
+  _head = (_head + 1) % QUEUE_SIZE;
+  _count--;
+  xSemaphoreGive(_mtx);
+
+  if (_hook)
+    _hook(_hookCtx, mac, delivered);
+}
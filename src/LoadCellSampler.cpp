@@ -0,0 +1,182 @@
+#include "LoadCellSampler.h"
+
+bool LoadCellSampler::begin(const Config &cfg)
+{
+  if (cfg.doutPin < 0 || cfg.sckPin < 0 || cfg.countsPerKg == 0)
+    return false;
+
+  _cfg = cfg;
+  _offset.store(cfg.offset);
+  pinMode(_cfg.sckPin, OUTPUT);
+  pinMode(_cfg.doutPin, INPUT);
+  digitalWrite(_cfg.sckPin, LOW);
+
+  if (!_task && xTaskCreatePinnedToCore(&LoadCellSampler::taskStatic, "loadcell", TASK_STACK, this, TASK_PRIO, &_task, TASK_CORE) != pdPASS)
+  {
+    _task = nullptr;
+    Serial.println("[SCALE] task create failed");
+    return false;
+  }
+  return true;
+}
+
+bool LoadCellSampler::snapshot(Snapshot &out) const
+{
+  if (!_snap.read(out))
+    return false;
+  if (millis() - out.atMs > _cfg.staleAfterMs)
+    out.ok = false;
+  return true;
+}
+
+bool LoadCellSampler::takeTare(int32_t &out)
+{
+  if (!_tareApplied.exchange(false))
+    return false;
+  out = _offset.load();
+  return true;
+}
+
+void LoadCellSampler::taskStatic(void *arg)
+{
+  static_cast<LoadCellSampler *>(arg)->taskLoop();
+}
+
+void LoadCellSampler::taskLoop()
+{
+  for (;;)
+  {
+    int32_t raw;
+    if (readRaw(raw))
+      onSample(raw, millis());
+  }
+}
+
+bool LoadCellSampler::readRaw(int32_t &out)
+{
+  // DOUT goes low when a conversion is ready (10 or 80 SPS); sleep instead of spinning
+  uint32_t startMs = millis();
+  while (digitalRead(_cfg.doutPin) != LOW)
+  {
+    if (millis() - startMs > _cfg.staleAfterMs)
+      return false;
+    vTaskDelay(pdMS_TO_TICKS(2));
+  }
+
+  // SCK high for > 60 us powers the chip down: clock the bits without being preempted
+  uint32_t v = 0;
+  portENTER_CRITICAL(&_ioMux);
+  for (uint8_t i = 0; i < 24; i++)
+  {
+    digitalWrite(_cfg.sckPin, HIGH);
+    delayMicroseconds(1);
+    v = (v << 1) | (digitalRead(_cfg.doutPin) == HIGH ? 1 : 0);
+    digitalWrite(_cfg.sckPin, LOW);
+    delayMicroseconds(1);
+  }
+  // 25th pulse: channel A, gain 128 for the next conversion
+  digitalWrite(_cfg.sckPin, HIGH);
+  delayMicroseconds(1);
+  digitalWrite(_cfg.sckPin, LOW);
+  portEXIT_CRITICAL(&_ioMux);
+
+  // 24-bit two's complement
+  if (v & 0x800000)
+    v |= 0xFF000000;
+  out = (int32_t)v;
+  return true;
+}
+
+int32_t LoadCellSampler::medianOfLast() const
+{
+  const uint8_t n = _ringCount < MEDIAN_N ? _ringCount : MEDIAN_N;
+  int32_t v[MEDIAN_N];
+  for (uint8_t i = 0; i < n; i++)
+    v[i] = _ring[(uint8_t)(_ringHead - 1 - i) % RING_SIZE];
+
+  // insertion sort, n <= 5
+  for (uint8_t i = 1; i < n; i++)
+  {
+    int32_t x = v[i];
+    int8_t j = i - 1;
+    while (j >= 0 && v[j] > x)
+    {
+      v[j + 1] = v[j];
+      j--;
+    }
+    v[j + 1] = x;
+  }
+  return v[n / 2];
+}
+
+void LoadCellSampler::resetWindow()
+{
+  _winHead = 0;
+  _winCount = 0;
+  _sum = 0;
+  _sumSq = 0;
+}
+
+void LoadCellSampler::onSample(int32_t raw, uint32_t nowMs)
+{
+  _ring[_ringHead] = raw;
+  _ringHead = (_ringHead + 1) % RING_SIZE;
+  if (_ringCount < RING_SIZE)
+    _ringCount++;
+
+  const int32_t med = medianOfLast();
+  if (!_iirInit)
+  {
+    _iir = med;
+    _iirInit = true;
+  }
+  else
+  {
+    _iir += (med - _iir) >> IIR_SHIFT;
+  }
+
+  if (_tareRequested.exchange(false))
+  {
+    // the weight jumps to 0: old samples would read as instability
+    _offset.store(_iir);
+    _tareApplied.store(true);
+    resetWindow();
+  }
+
+  const int64_t net = (int64_t)(_iir - _offset.load());
+  const int32_t weightG = (int32_t)(net * 1000 / _cfg.countsPerKg);
+  const int32_t weightQ4 = (int32_t)(net * 16000 / _cfg.countsPerKg); // 1/16 g
+
+  // rolling window: add the new weight, drop the one it replaces
+  if (_winCount == WINDOW)
+  {
+    const int32_t old = _win[_winHead];
+    _sum -= old;
+    _sumSq -= (int64_t)old * old;
+  }
+  else
+  {
+    _winCount++;
+  }
+  _win[_winHead] = weightQ4;
+  _winHead = (_winHead + 1) % WINDOW;
+  _sum += weightQ4;
+  _sumSq += (int64_t)weightQ4 * weightQ4;
+
+  // var = (n * sum(x^2) - sum(x)^2) / n^2, in 1/256 g^2
+  const int64_t n = _winCount;
+  int64_t varQ8 = (n * _sumSq - _sum * _sum) / (n * n);
+  if (varQ8 < 0)
+    varQ8 = 0;
+  const int64_t var = (varQ8 + 128) >> 8;
+  const uint16_t variance = var > 0xFFFF ? 0xFFFF : (uint16_t)var;
+
+  Snapshot s;
+  s.ok = true;
+  s.stable = _winCount == WINDOW && varQ8 <= ((int64_t)_cfg.stableVariance << 8);
+  s.weightG = weightG;
+  s.variance = variance;
+  s.atMs = nowMs;
+  s.samples = ++_samples;
+  _snap.write(s);
+}
@@ -171,9 +171,18 @@ OtaService::Result OtaService::runUpdate(const String &url, LogFn log)
   WiFiClient *stream = http.getStreamPtr();
   size_t written = 0;
   uint8_t buff[1024];
+  const uint32_t startMs = millis();
 
   while (http.connected() && written < (size_t)len)
   {
+    if (_cfg.downloadTimeoutMs > 0 && millis() - startMs > _cfg.downloadTimeoutMs)
+    {
+      logLine(log, String("[OTA] Download timeout written=") + written + " expected=" + len);
+      Update.abort();
+      http.end();
+      return Result::Timeout;
+    }
+
     size_t avail = stream->available();
     if (avail)
     {
@@ -135,6 +135,13 @@ bool PreferenceService::setBytes(const char *key, const void *buf, size_t len)
   return _prefs.putBytes(key, buf, len) == len;
 }
 
+size_t PreferenceService::getBytesLength(const char *key) const
+{
+  if (!_started)
+    return 0;
+  return _prefs.getBytesLength(key);
+}
+
 bool PreferenceService::removeKey(const char *key)
 {
   if (!_started)
@@ -398,6 +405,26 @@ bool PreferenceService::clearTopologyJson()
   return removeKey(K_TOPOLOGY_JSON);
 }
 
+size_t PreferenceService::topologyBlobLength() const
+{
+  return getBytesLength(K_TOPOLOGY_BLOB);
+}
+
+size_t PreferenceService::loadTopologyBlob(void *buf, size_t maxLen) const
+{
+  return getBytes(K_TOPOLOGY_BLOB, buf, maxLen);
+}
+
+bool PreferenceService::saveTopologyBlob(const void *buf, size_t len)
+{
+  return setBytes(K_TOPOLOGY_BLOB, buf, len);
+}
+
+bool PreferenceService::clearTopologyBlob()
+{
+  return removeKey(K_TOPOLOGY_BLOB);
+}
+
 // Probe
 bool PreferenceService::hasProbeNowConfig() const
 {
@@ -428,19 +455,61 @@ bool PreferenceService::clearProbeNowConfig()
   ok |= removeKey(K_PNOW_GWMAC);
   ok |= removeKey(K_PNOW_LMK);
   ok |= removeKey(K_PNOW_GWHMAC);
+  ok |= removeKey(K_PNOW_CHAN);
   return ok;
 }
 
-uint32_t PreferenceService::getPnowLastSeq() const
+uint32_t PreferenceService::getPnowSeqCeiling() const
 {
   return getUInt(K_PNOW_SEQ, 0);
 }
 
-bool PreferenceService::setPnowLastSeq(uint32_t seq)
+bool PreferenceService::setPnowSeqCeiling(uint32_t seq)
 {
   return setUInt(K_PNOW_SEQ, seq);
 }
 
+uint32_t PreferenceService::getPnowGwSeqCeiling() const
+{
+  return getUInt(K_PNOW_GWSEQ, 0);
+}
+
+bool PreferenceService::setPnowGwSeqCeiling(uint32_t seq)
+{
+  return setUInt(K_PNOW_GWSEQ, seq);
+}
+
+uint8_t PreferenceService::getPnowChannel() const
+{
+  const uint32_t ch = getUInt(K_PNOW_CHAN, 0);
+  return ch <= 14 ? (uint8_t)ch : 0;
+}
+
+bool PreferenceService::setPnowChannel(uint8_t channel)
+{
+  return setUInt(K_PNOW_CHAN, channel);
+}
+
+int32_t PreferenceService::getScaleOffset() const
+{
+  return getInt(K_SCALE_OFFSET, 0);
+}
+
+bool PreferenceService::setScaleOffset(int32_t counts)
+{
+  return setInt(K_SCALE_OFFSET, counts);
+}
+
+int32_t PreferenceService::getScaleCountsPerKg() const
+{
+  return getInt(K_SCALE_CPKG, 0);
+}
+
+bool PreferenceService::setScaleCountsPerKg(int32_t counts)
+{
+  return setInt(K_SCALE_CPKG, counts);
+}
+
 // ---------------- Debug ----------------
 
 String PreferenceService::maskSecret(const String &s, int keep)
@@ -499,6 +568,7 @@ void PreferenceService::dumpToSerial(bool includeSecrets) const
   // Topology
   String topo = getString(K_TOPOLOGY_JSON, "");
   Serial.printf("[PREF] topology_json.len=%u\n", (unsigned)topo.length());
+  Serial.printf("[PREF] topology_bin.len=%u\n", (unsigned)getBytesLength(K_TOPOLOGY_BLOB));
 
   Serial.println("[PREF] --------------");
 }
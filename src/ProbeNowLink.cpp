@@ -1,4 +1,5 @@
 #include "ProbeNowLink.h"
+#include <esp_wifi.h>
 #include <mbedtls/base64.h>
 
 ProbeNowLink *ProbeNowLink::_self = nullptr;
@@ -67,6 +68,17 @@ bool ProbeNowLink::begin(const PeerConfig &peer, RxHandler onRx)
   else if (mode != WIFI_STA && mode != WIFI_AP_STA)
     WiFi.mode(WIFI_STA);
 
+  // not associated: the radio stays on whatever channel it last used unless told otherwise
+  if (_peer.channel != 0 && esp_wifi_set_channel(_peer.channel, WIFI_SECOND_CHAN_NONE) != ESP_OK)
+    Serial.printf("[PNOW] set channel %u failed\n", _peer.channel);
+
+  if (!_task && xTaskCreatePinnedToCore(&ProbeNowLink::taskStatic, "pnow_rx", TASK_STACK, this, TASK_PRIO, &_task, TASK_CORE) != pdPASS)
+  {
+    _task = nullptr;
+    Serial.println("[PNOW] rx task create failed");
+    return false;
+  }
+
   if (esp_now_init() != ESP_OK)
   {
     Serial.println("[PNOW] esp_now_init failed");
@@ -76,6 +88,15 @@ bool ProbeNowLink::begin(const PeerConfig &peer, RxHandler onRx)
   esp_now_register_recv_cb(&ProbeNowLink::recvStatic);
   _self = this;
 
+  _lossStreak = 0;
+  if (!_tx.begin(&ProbeNowLink::txResultStatic, this))
+  {
+    Serial.println("[PNOW] tx init failed");
+    esp_now_deinit();
+    _self = nullptr;
+    return false;
+  }
+
   esp_now_peer_info_t pi{};
   memcpy(pi.peer_addr, _peer.mac, 6);
   pi.channel = 0;
@@ -94,6 +115,7 @@ bool ProbeNowLink::begin(const PeerConfig &peer, RxHandler onRx)
   if (esp_now_add_peer(&pi) != ESP_OK)
   {
     Serial.println("[PNOW] add peer failed");
+    _tx.end();
     esp_now_deinit();
     _self = nullptr;
     return false;
@@ -108,6 +130,7 @@ void ProbeNowLink::end()
 {
   if (!_ready)
     return;
+  _tx.end();
   esp_now_deinit();
   _ready = false;
   _self = nullptr;
@@ -117,12 +140,60 @@ bool ProbeNowLink::send(const uint8_t *data, size_t len)
 {
   if (!_ready)
     return false;
-  return esp_now_send(_peer.mac, data, len) == ESP_OK;
+  return _tx.send(_peer.mac, data, len);
+}
+
+bool ProbeNowLink::setChannel(uint8_t channel)
+{
+  // the peer was added with channel 0 (= current), so it follows the radio
+  if (esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) != ESP_OK)
+    return false;
+  _peer.channel = channel;
+  return true;
+}
+
+void ProbeNowLink::txResultStatic(void *ctx, const uint8_t mac[6], bool delivered)
+{
+  // TX task
+  ProbeNowLink *self = static_cast<ProbeNowLink *>(ctx);
+  if (delivered)
+    self->_lossStreak = 0;
+  else if (self->_lossStreak < 0xFF)
+    self->_lossStreak++;
 }
 
 void ProbeNowLink::recvStatic(const uint8_t *mac, const uint8_t *data, int len)
 {
-  if (!_self || !_self->_rx)
+  // WiFi task: copy and hand off, nothing else
+  if (!_self || len <= 0 || len > ESP_NOW_MAX_DATA_LEN)
     return;
-  _self->_rx(mac, data, len);
+
+  RxFrame *f = _self->_ring.beginPush();
+  if (!f)
+    return;
+  memcpy(f->mac, mac, 6);
+  f->len = (uint8_t)len;
+  memcpy(f->data, data, len);
+  _self->_ring.commitPush();
+
+  xTaskNotifyGive(_self->_task);
+}
+
+void ProbeNowLink::taskStatic(void *arg)
+{
+  static_cast<ProbeNowLink *>(arg)->taskLoop();
+}
+
+void ProbeNowLink::taskLoop()
+{
+  RxFrame f;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (_ring.pop(f))
+    {
+      if (_rx)
+        _rx(f.mac, f.data, f.len);
+    }
+  }
 }
@@ -21,8 +21,15 @@ static String macNoSep()
   return m;
 }
 
+static OtaService::Config otaConfig(const ProbeRunService::Config &cfg)
+{
+  OtaService::Config c;
+  c.downloadTimeoutMs = cfg.otaTimeoutMs;
+  return c;
+}
+
 ProbeRunService::ProbeRunService(PreferenceService &prefs, const Config &cfg)
-    : _prefs(prefs), _cfg(cfg), _ota(_prefs)
+    : _prefs(prefs), _cfg(cfg), _ota(_prefs, otaConfig(cfg))
 {
   _self = this;
 }
@@ -33,10 +40,55 @@ void ProbeRunService::begin()
   _espOnly = false;
   _lastTokenCheckMs = 0;
   _nextRegisterMs = 0;
-  _lastSeqSeen = _prefs.getPnowLastSeq();
-  Serial.printf("[PROBE] begin (lastSeq=%lu)\n", (unsigned long)_lastSeqSeen);
+  _nextTokenUpkeepMs = millis() + _cfg.tokenCheckEveryMs;
+  // resume above everything that may have run before the reset, then reserve the next block
+  // (boot, not the RX path, pays for this write)
+  _seqFloor = _prefs.getPnowSeqCeiling();
+  _replay.reset(_seqFloor);
+
+  const uint32_t nowMs = millis();
+  _buckets[CLASS_CONTROL].configure(_cfg.controlBurst, _cfg.controlRefillMs, nowMs);
+  _buckets[CLASS_TELEMETRY].configure(_cfg.telemetryBurst, _cfg.telemetryRefillMs, nowMs);
+  _buckets[CLASS_WRITE].configure(_cfg.writeBurst, _cfg.writeRefillMs, nowMs);
+  if (!_execTask && xTaskCreatePinnedToCore(&ProbeRunService::execTaskStatic, "probe_exec", EXEC_TASK_STACK, this, EXEC_TASK_PRIO, &_execTask, EXEC_TASK_CORE) != pdPASS)
+  {
+    _execTask = nullptr;
+    Serial.println("[PROBE] executor task create failed");
+  }
+  _seqCeiling = _seqFloor;
+  _seqCeilingWanted = _seqFloor + SEQ_RESERVE;
+  persistSeqCeiling();
+  // random start: the gateway's duplicate filter never mistakes a rebooted probe for a replay
+  _pushSeq = esp_random();
+  _hasPushed = false;
+
+  LoadCellSampler::Config sc;
+  sc.doutPin = _cfg.scaleDoutPin;
+  sc.sckPin = _cfg.scaleSckPin;
+  sc.offset = _prefs.getScaleOffset();
+  const int32_t cpkg = _prefs.getScaleCountsPerKg();
+  sc.countsPerKg = cpkg != 0 ? cpkg : _cfg.scaleCountsPerKg;
+  if (_scale.begin(sc))
+    Serial.println("[SCALE] sampling");
+  Serial.printf("[PROBE] begin (seqFloor=%lu)\n", (unsigned long)_seqFloor);
+
+  // fast boot: registered and the gateway's channel is known -> no WiFi association, DHCP,
+  // NTP or HTTPS; those only come up for registration (below, in loop) and OTA
+  const uint8_t channel = _prefs.getPnowChannel();
+  if (channel != 0 && _prefs.hasProbeNowConfig())
+  {
+    if (ensureEspNow())
+    {
+      _espOnly = true;
+      Serial.printf("[PROBE] fast boot -> ESPNOW-only (ch %u, %lu ms)\n", channel, (unsigned long)millis());
+      return;
+    }
+    Serial.println("[PROBE] fast boot failed, falling back to WiFi");
+  }
 
-  ensureWifiAndTime();
+  // registered but no channel yet: loop() only joins WiFi to learn it, no time sync
+  if (!_prefs.hasProbeNowConfig())
+    ensureWifiAndTime();
 }
 
 void ProbeRunService::loop()
@@ -47,34 +99,81 @@ void ProbeRunService::loop()
   // If we already switched to ESPNOW only, just run periodic work
   if (_espOnly)
   {
-    // TODO: heartbeat / telemetry
-    if (millis() - _lastHeartbeatMs > 5000)
+    persistSeqCeiling();
+
+    // a failed OTA left WiFi off: bring the link back up (from cached config and channel)
+    if (_linkRestart.exchange(false))
     {
-      _lastHeartbeatMs = millis();
-      const char *msg = "probe:heartbeat";
-      _link.send((const uint8_t *)msg, strlen(msg));
+      _link.end();
+      if (!ensureEspNow())
+        Serial.println("[PROBE] ESPNOW restart failed");
     }
+
+    // gateway changed channel: it told us, or our frames stopped getting through
+    const uint8_t announced = _announcedChannel.exchange(0);
+    if (announced != 0)
+      useChannel(announced);
+    // not while a command runs (OTA joins WiFi, which owns the channel then)
+    if (!_execBusy && _link.lossStreak() >= _cfg.scanAfterLosses && (int32_t)(millis() - _nextScanMs) >= 0)
+      scanForGateway();
+
+    checkExecWatchdog();
+
+    // token upkeep: the check is cheap (NVS + clock); WiFi/NTP/HTTPS run on the executor, like
+    // OTA, so pushes keep going. Commands get ERR_BUSY meanwhile
+    if (_execTask && (int32_t)(millis() - _nextTokenUpkeepMs.load()) >= 0)
+    {
+      bool idle = false;
+      if (!tokenUpkeepDue())
+      {
+        _nextTokenUpkeepMs = millis() + _cfg.tokenCheckEveryMs;
+      }
+      else if (_execBusy.compare_exchange_strong(idle, true))
+      {
+        _tokenUpkeep = true;
+        xTaskNotifyGive(_execTask);
+      }
+    }
+
+    // a tare is applied by the sampler task; persist it here, off the sampling and RX paths
+    int32_t offset;
+    if (_scale.takeTare(offset) && !_prefs.setScaleOffset(offset))
+      Serial.println("[SCALE] failed to persist tare");
+
+    // push on change; otherwise a keepalive (same frame, so it also repairs a lost push)
+    pnow::TelemetryPayload cur{};
+    readTelemetry(cur);
+    uint32_t nowMs = millis();
+    if (telemetryChanged(cur) && nowMs - _lastPushMs >= _cfg.pushMinIntervalMs)
+      pushTelemetry(cur, pnow::TEL_CHANGE);
+    else if (nowMs - _lastPushMs >= _cfg.keepaliveMs)
+      pushTelemetry(cur, pnow::TEL_KEEPALIVE);
     delay(5);
     return;
   }
 
-  ensureWifiAndTime();
-
-  // token maintenance
-  if ((int32_t)(millis() - _lastTokenCheckMs) > (int32_t)_cfg.tokenCheckEveryMs)
+  // registered: WiFi is only needed to learn the gateway's channel (no token, no HTTPS)
+  if (_prefs.hasProbeNowConfig())
+  {
+    if (WiFi.status() != WL_CONNECTED)
+      wifiConnectSTA();
+  }
+  else
   {
-    _lastTokenCheckMs = millis();
-    if (!ensureValidToken())
+    ensureWifiAndTime();
+
+    // token maintenance (registration is the only HTTPS call)
+    if ((int32_t)(millis() - _lastTokenCheckMs) > (int32_t)_cfg.tokenCheckEveryMs)
     {
-      Serial.println("[PROBE] token invalid and refresh failed");
-      delay(250);
-      return;
+      _lastTokenCheckMs = millis();
+      if (!ensureValidToken())
+      {
+        Serial.println("[PROBE] token invalid and refresh failed");
+        delay(250);
+        return;
+      }
     }
-  }
 
-  // registerProbe if needed
-  if (!_prefs.hasProbeNowConfig())
-  {
     if ((int32_t)(millis() - _nextRegisterMs) >= 0)
     {
       if (registerProbe())
@@ -144,6 +243,32 @@ bool ProbeRunService::ensureValidToken()
   return authRefresh();
 }
 
+bool ProbeRunService::tokenUpkeepDue() const
+{
+  // nothing to keep fresh before registration's tokens exist
+  if (_prefs.getAccessToken().length() == 0 || _prefs.getRefreshToken().length() == 0)
+    return false;
+  // fast boot never syncs the clock: without it the expiry can't be judged
+  if (!netutils::timeIsValid(netutils::nowUnix()))
+    return true;
+  return !tokenValidSoon();
+}
+
+void ProbeRunService::tokenUpkeep()
+{
+  // executor task. The AP is the gateway's: associating keeps the radio on its channel
+  const bool ok = wifiConnectSTA() && ensureTimeSynced() && ensureValidToken();
+  // drop the association but stay in STA mode (WiFi off would take ESP-NOW down)
+  WiFi.disconnect(false);
+
+  const uint32_t waitMs = ok ? _cfg.tokenCheckEveryMs : _cfg.tokenRetryMs;
+  _nextTokenUpkeepMs = millis() + waitMs;
+  if (ok)
+    Serial.println("[PROBE] token upkeep OK");
+  else
+    Serial.printf("[PROBE] token upkeep failed, retry in %lu s\n", (unsigned long)(waitMs / 1000));
+}
+
 bool ProbeRunService::authRefresh()
 {
   String refresh = _prefs.getRefreshToken();
@@ -288,12 +413,28 @@ bool ProbeRunService::ensureEspNow()
   }
   peer.hasLmk = true;
 
-  memcpy(_gatewayMac, peer.mac, 6);
-  _gatewayMacCached = true;
+  // the RX task reads it: only written when it actually changes
+  if (!_gatewayMacCached || memcmp(_gatewayMac, peer.mac, 6) != 0)
+  {
+    memcpy(_gatewayMac, peer.mac, 6);
+    _gatewayMacCached = true;
+  }
 
-  // disconnect WiFi but keep STA mode
-  WiFi.disconnect(true, true);
-  delay(100);
+  // the gateway sits on the same AP: while associated, its channel is the AP's; remember it
+  // for the next boot. Otherwise (fast boot, after a failed OTA) use the cached one
+  peer.channel = _prefs.getPnowChannel();
+  if (WiFi.status() == WL_CONNECTED)
+  {
+    const uint8_t ch = (uint8_t)WiFi.channel();
+    if (ch != 0 && ch != peer.channel && !_prefs.setPnowChannel(ch))
+      Serial.println("[PROBE] failed to persist channel");
+    if (ch != 0)
+      peer.channel = ch;
+
+    // disconnect WiFi but keep STA mode
+    WiFi.disconnect(true, true);
+    delay(100);
+  }
 
   return _link.begin(peer, &ProbeRunService::onRxStatic);
 }
@@ -329,29 +470,183 @@ static bool macEquals6(const uint8_t *a, const uint8_t *b)
   return memcmp(a, b, 6) == 0;
 }
 
-void ProbeRunService::sendAck(uint32_t seq, bool ok, uint8_t err, uint32_t arg)
+uint8_t ProbeRunService::commandClass(uint8_t type)
 {
-  uint8_t buf[sizeof(pnow::Header) + sizeof(pnow::AckPayload)];
-  pnow::Header h{};
-  h.v = pnow::PN_VERSION;
-  h.type = pnow::RSP_ACK;
-  h.len = sizeof(pnow::AckPayload);
-  h.seq = seq;
-  h.ts = 0;
+  switch (type)
+  {
+  case pnow::CMD_STATUS:
+  case pnow::CMD_TELEMETRY:
+    return CLASS_TELEMETRY;
+  case pnow::CMD_WRITE:
+    return CLASS_WRITE;
+  default:
+    return CLASS_CONTROL;
+  }
+}
+
+void ProbeRunService::persistSeqCeiling()
+{
+  // loop task: the only writer of the stored ceiling
+  const uint32_t want = _seqCeilingWanted;
+  if (want <= _seqCeiling)
+    return;
+  if (!_prefs.setPnowSeqCeiling(want))
+  {
+    Serial.println("[PNOW] failed to persist seq ceiling");
+    return;
+  }
+  _seqCeiling = want;
+}
+
+bool ProbeRunService::scanForGateway()
+{
+  const uint8_t home = _link.channel();
+  Serial.printf("[PROBE] gateway unreachable (%u lost), scanning\n", _link.lossStreak());
+
+  // home channel first (the losses may just have been interference), then upward
+  for (uint8_t i = 0; i < pnow::PN_CHANNEL_MAX; i++)
+  {
+    const uint8_t ch = (uint8_t)(((home > 0 ? home - 1 : 0) + i) % pnow::PN_CHANNEL_MAX + 1);
+    if (!_link.setChannel(ch))
+      continue; // not allowed in this country
+    const uint8_t found = pingGateway();
+    if (found == 0)
+      continue;
+
+    useChannel(found);
+    _scanRetryMs = 0;
+    // tell the gateway right away instead of at the next keepalive
+    _lastPushMs = millis() - _cfg.keepaliveMs;
+    Serial.printf("[PROBE] gateway found on ch %u\n", found);
+    return true;
+  }
 
+  if (home != 0)
+    _link.setChannel(home);
+  _scanRetryMs = _scanRetryMs == 0 ? _cfg.scanRetryMs : _scanRetryMs * 2;
+  if (_scanRetryMs > _cfg.scanRetryMaxMs)
+    _scanRetryMs = _cfg.scanRetryMaxMs;
+  _nextScanMs = millis() + _scanRetryMs;
+  Serial.printf("[PROBE] gateway not found, next scan in %lu ms\n", (unsigned long)_scanRetryMs);
+  return false;
+}
+
+uint8_t ProbeRunService::pingGateway()
+{
+  // seq from the push counter: the gateway's push de-dup never sees it go backwards
+  const uint32_t seq = ++_pushSeq;
+  _pingChannel = 0;
+  _pingSeq = seq;
+  const EspNowTx::Stats before = _link.txStats();
+  sendFrame(pnow::EVT_PING, seq, nullptr, 0);
+
+  const uint32_t startMs = millis();
+  while (millis() - startMs < _cfg.scanDwellMs)
+  {
+    const uint8_t ch = _pingChannel;
+    if (ch != 0)
+      return ch; // the gateway's own word, even if we heard it from a neighbouring channel
+    if (_link.txStats().failed != before.failed)
+      return 0; // no MAC-level ACK: nobody here
+    delay(5);
+  }
+  // delivered but not answered (e.g. it could not decrypt it yet): its radio is on this channel
+  return _link.txStats().delivered != before.delivered ? _link.channel() : 0;
+}
+
+void ProbeRunService::useChannel(uint8_t channel)
+{
+  if (channel != _link.channel() && !_link.setChannel(channel))
+  {
+    Serial.printf("[PROBE] set channel %u failed\n", channel);
+    return;
+  }
+  if (channel != _prefs.getPnowChannel() && !_prefs.setPnowChannel(channel))
+    Serial.println("[PROBE] failed to persist channel");
+}
+
+void ProbeRunService::sendFrame(uint8_t type, uint32_t seq, const void *payload, uint16_t len)
+{
+  uint8_t buf[pnow::PN_MAX_FRAME];
+  size_t n = pnow::build_frame(buf, sizeof(buf), type, seq, payload, len);
+  if (n > 0)
+    _link.send(buf, n);
+}
+
+void ProbeRunService::sendAck(uint32_t seq, bool ok, uint8_t err, uint32_t arg)
+{
   pnow::AckPayload p{};
   p.ok = ok ? 1 : 0;
   p.err = err;
   p.arg = arg;
+  sendFrame(pnow::RSP_ACK, seq, &p, sizeof(p));
+}
+
+void ProbeRunService::sendStatus(uint32_t seq)
+{
+  pnow::StatusPayload p{};
+  p.uptime_s = millis() / 1000;
+  LoadCellSampler::Snapshot s;
+  if (_scale.snapshot(s) && s.ok)
+  {
+    p.last_weight_g = s.weightG;
+    p.flags = pnow::STATUS_SCALE_OK | (s.stable ? pnow::STATUS_SCALE_STABLE : 0);
+  }
+  sendFrame(pnow::RSP_STATUS, seq, &p, sizeof(p));
+}
 
-  memcpy(buf, &h, sizeof(h));
-  memcpy(buf + sizeof(h), &p, sizeof(p));
+void ProbeRunService::sendTelemetry(uint32_t seq)
+{
+  // RX path: snapshot copied straight into an exact-size stack frame, no heap, no sensor I/O.
+  // ok=0 tells the gateway "no data" instead of a timeout.
+  uint8_t frame[sizeof(pnow::Header) + sizeof(pnow::TelemetryPayload)];
+  pnow::TelemetryPayload *p = reinterpret_cast<pnow::TelemetryPayload *>(frame + sizeof(pnow::Header));
+  readTelemetry(*p);
+  p->reason = pnow::TEL_REPLY;
+  size_t n = pnow::seal_frame(frame, sizeof(frame), pnow::RSP_TELEMETRY, seq, sizeof(pnow::TelemetryPayload));
+  if (n > 0)
+    _link.send(frame, n);
+}
 
-  // write CRC
-  pnow::Header *ph = (pnow::Header *)buf;
-  ph->crc32 = pnow::compute_crc(*ph, buf + sizeof(pnow::Header));
+void ProbeRunService::readTelemetry(pnow::TelemetryPayload &out) const
+{
+  // snapshot only: the sensor is never read here (no RFID driver yet, uid stays empty)
+  out = pnow::TelemetryPayload{};
+  LoadCellSampler::Snapshot s;
+  if (!_scale.snapshot(s) || !s.ok)
+    return;
+  out.ok = 1;
+  out.weight_g = s.weightG;
+  out.variance = s.variance;
+  out.weight_at_ms = s.atMs;
+}
+
+bool ProbeRunService::telemetryChanged(const pnow::TelemetryPayload &cur) const
+{
+  if (!_hasPushed)
+    return cur.ok != 0;
+  if (cur.ok != _pushed.ok)
+    return true;
+  if (!cur.ok)
+    return false;
+  // tag appeared, left or was swapped
+  if (memcmp(cur.uid, _pushed.uid, sizeof(cur.uid)) != 0)
+    return true;
+  int32_t d = cur.weight_g - _pushed.weight_g;
+  return (d < 0 ? -d : d) > _cfg.pushWeightDeltaG;
+}
 
-  _link.send(buf, sizeof(buf));
+void ProbeRunService::pushTelemetry(const pnow::TelemetryPayload &cur, uint8_t reason)
+{
+  if (reason == pnow::TEL_CHANGE)
+    _pushChanges++;
+  pnow::TelemetryPayload p = cur;
+  p.reason = pnow::tel_pack_reason(reason, _pushChanges);
+  sendFrame(pnow::EVT_TELEMETRY, ++_pushSeq, &p, sizeof(p));
+
+  _pushed = cur;
+  _hasPushed = true;
+  _lastPushMs = millis();
 }
 
 void ProbeRunService::onRx(const uint8_t *mac, const uint8_t *data, int len)
@@ -387,56 +682,180 @@ void ProbeRunService::onRx(const uint8_t *mac, const uint8_t *data, int len)
     return;
   }
 
-  // ---- 2) Anti-replay (seq must increase) ----
-  if (h.seq <= _lastSeqSeen)
+  // ---- 1b) Ack of our channel-scan ping: not a command (no replay/rate checks) ----
+  if (h.type == pnow::RSP_ACK)
   {
-    sendAck(h.seq, false, pnow::ERR_REPLAY, _lastSeqSeen);
+    pnow::AckPayload a{};
+    if (h.len >= sizeof(a) && h.seq == _pingSeq.load())
+    {
+      memcpy(&a, payload, sizeof(a));
+      if (a.ok && pnow::channel_valid(a.arg))
+        _pingChannel = (uint8_t)a.arg;
+    }
     return;
   }
 
-  // ---- 3) Rate limit (except STATUS) ----
-  uint32_t nowMs = millis();
-  if (h.type != pnow::CMD_STATUS)
+  // ---- 2) Anti-replay (seq new within the window) ----
+  if (!_replay.check(h.seq))
   {
-    if ((uint32_t)(nowMs - _lastCmdAtMs) < 200)
-    {
-      sendAck(h.seq, false, pnow::ERR_RATE_LIMIT, 0);
+    // a retransmit of the command the executor is running: its ACK follows
+    if (_execBusy && h.seq == _execSeq)
       return;
+    pnow::AckPayload a{};
+    a.err = pnow::ERR_REPLAY;
+    a.arg = _replay.top();
+    if (h.seq <= _seqFloor)
+      a.flags = pnow::ACK_SEQ_FLOOR;
+    sendFrame(pnow::RSP_ACK, h.seq, &a, sizeof(a));
+    return;
+  }
+
+  // ---- 2b) Seq must be covered by the persisted ceiling (no flash write on this path) ----
+  if (h.seq > _seqCeiling)
+  {
+    // rare: the gateway jumped ahead of the reserve; loop() persists, the gateway resends
+    uint32_t want = h.seq + SEQ_RESERVE;
+    if (want > _seqCeilingWanted)
+      _seqCeilingWanted = want;
+    sendAck(h.seq, false, pnow::ERR_BUSY, 0);
+    return;
+  }
+  if (_seqCeiling - h.seq < SEQ_REFILL && h.seq + SEQ_RESERVE > _seqCeilingWanted)
+    _seqCeilingWanted = h.seq + SEQ_RESERVE;
+
+  // ---- 2c) One command at a time on the executor (not run, so the seq is not burnt) ----
+  const bool read = h.type == pnow::CMD_STATUS || h.type == pnow::CMD_TELEMETRY;
+  if (!read && _execBusy)
+  {
+    sendAck(h.seq, false, pnow::ERR_BUSY, 0);
+    return;
+  }
+
+  // ---- 3) Rate limit (token bucket of the command's class) ----
+  TokenBucket &bucket = _buckets[commandClass(h.type)];
+  if (!bucket.take(millis()))
+  {
+    sendAck(h.seq, false, pnow::ERR_RATE_LIMIT, pnow::rate_limit_arg(bucket.milliTokens(), bucket.msUntilToken()));
+    return;
+  }
+
+  // ---- 4) Reads: answered here from the lock-free snapshot ----
+  if (h.type == pnow::CMD_STATUS)
+  {
+    _replay.mark(h.seq);
+    sendStatus(h.seq);
+    return;
+  }
+  if (h.type == pnow::CMD_TELEMETRY)
+  {
+    _replay.mark(h.seq);
+    sendTelemetry(h.seq);
+    return;
+  }
+
+  // ---- 5) Everything else: hand over to the executor ----
+  ExecCommand *c = _exec.beginPush();
+  if (!c || !_execTask)
+  {
+    sendAck(h.seq, false, pnow::ERR_BUSY, 0);
+    return;
+  }
+  c->type = h.type;
+  c->seq = h.seq;
+  c->len = h.len;
+  memcpy(c->payload, payload, h.len);
+  _execSeq = h.seq;
+  _execBusy = true;
+  _exec.commitPush();
+  _replay.mark(h.seq);
+  xTaskNotifyGive(_execTask);
+}
+
+void ProbeRunService::execTaskStatic(void *arg)
+{
+  static_cast<ProbeRunService *>(arg)->execLoop();
+}
+
+void ProbeRunService::execLoop()
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    ExecCommand c;
+    while (_exec.pop(c))
+    {
+      _execType = c.type;
+      _execStartedMs = millis();
+      _execAcked = false;
+      _execRunning = true;
+      execute(c);
+      _execRunning = false;
+      _execBusy = false;
+    }
+    if (_tokenUpkeep.exchange(false))
+    {
+      tokenUpkeep();
+      _execBusy = false;
     }
   }
-  _lastCmdAtMs = nowMs;
-  _lastSeqSeen = h.seq;
-  _prefs.setPnowLastSeq(h.seq);
+}
 
-  // ---- 4) Dispatch ----
-  switch ((pnow::MsgType)h.type)
+void ProbeRunService::sendExecAck(uint32_t seq, bool ok, uint8_t err, uint32_t arg)
+{
+  if (!_execAcked.exchange(true))
+    sendAck(seq, ok, err, arg);
+}
+
+void ProbeRunService::checkExecWatchdog()
+{
+  // loop task: TARE/CHANNEL/REBOOT/RESET return at once, OTA within its download budget
+  if (!_execRunning)
+    return;
+  const uint32_t ranMs = millis() - _execStartedMs.load();
+  const uint32_t budgetMs = _cfg.cmdTimeoutMs + (_execType == pnow::CMD_OTA ? _cfg.otaTimeoutMs : 0);
+  if (ranMs <= budgetMs)
+    return;
+
+  // the gateway stops waiting; the handler's own ACK, if it ever comes, is dropped
+  if (!_execAcked.exchange(true))
   {
-  case pnow::CMD_STATUS:
+    sendAck(_execSeq, false, pnow::ERR_TIMEOUT, ranMs);
+    Serial.printf("[PNOW] cmd %u overran (%lu ms) -> ERR_TIMEOUT\n", _execType.load(), (unsigned long)ranMs);
+  }
+  // the executor is wedged: nothing else can run until it returns
+  if (ranMs > budgetMs + _cfg.cmdTimeoutMs)
   {
-    sendAck(h.seq, true, pnow::ERR_OK, 0);
-    Serial.printf("[PNOW] STATUS seq=%lu\n", (unsigned long)h.seq);
-    break;
+    Serial.println("[PNOW] executor stuck -> reboot");
+    delay(100);
+    ESP.restart();
   }
+}
 
+void ProbeRunService::execute(const ExecCommand &c)
+{
+  // executor task: may block (flash, restart, OTA); the RX task and loop() keep running
+  switch ((pnow::MsgType)c.type)
+  {
   case pnow::CMD_REBOOT:
   {
-    sendAck(h.seq, true, pnow::ERR_OK, 0);
+    sendExecAck(c.seq, true, pnow::ERR_OK, 0);
     Serial.println("[PNOW] REBOOT");
-    delay(200);
+    delay(200); // let the ACK go out
     ESP.restart();
     break;
   }
 
   case pnow::CMD_RESET:
   {
-    if (h.len < sizeof(pnow::ResetPayload))
+    if (c.len < sizeof(pnow::ResetPayload))
     {
-      sendAck(h.seq, false, pnow::ERR_BAD_LEN, 0);
+      sendExecAck(c.seq, false, pnow::ERR_BAD_LEN, 0);
       break;
     }
 
     pnow::ResetPayload rp{};
-    memcpy(&rp, payload, sizeof(rp));
+    memcpy(&rp, c.payload, sizeof(rp));
 
     uint32_t t = millis();
     if (!_resetArmed || t > _resetArmedUntilMs || _resetNonce != rp.nonce)
@@ -445,13 +864,13 @@ void ProbeRunService::onRx(const uint8_t *mac, const uint8_t *data, int len)
       _resetArmed = true;
       _resetNonce = rp.nonce;
       _resetArmedUntilMs = t + 8000; // 8s window
-      sendAck(h.seq, true, pnow::ERR_OK, rp.nonce);
+      sendExecAck(c.seq, true, pnow::ERR_OK, rp.nonce);
       Serial.printf("[PNOW] RESET armed nonce=%lu\n", (unsigned long)rp.nonce);
       break;
     }
 
     // Confirm (same nonce within window)
-    sendAck(h.seq, true, pnow::ERR_OK, rp.nonce);
+    sendExecAck(c.seq, true, pnow::ERR_OK, rp.nonce);
     Serial.println("[PNOW] RESET confirmed -> clear prefs + reboot");
 
     _prefs.clearAll(); // <-- implement / or call your typed "factoryReset"
@@ -462,62 +881,66 @@ void ProbeRunService::onRx(const uint8_t *mac, const uint8_t *data, int len)
 
   case pnow::CMD_TARE:
   {
-    sendAck(h.seq, true, pnow::ERR_OK, 0);
+    _scale.requestTare();
+    sendExecAck(c.seq, true, pnow::ERR_OK, 0);
     Serial.println("[PNOW] TARE");
-
-    // TODO: call your tare routine here
-    // e.g. _scale.tare();
-
     break;
   }
 
-  case pnow::CMD_TELEMETRY:
+  case pnow::CMD_WRITE:
   {
-    sendAck(h.seq, true, pnow::ERR_OK, 0);
-    Serial.println("[PNOW] TELEMETRY requested");
-
-    // TODO: read sensors (weight + RFID) and send a RSP_TELEMETRY packet
-    // (If payload might be big, keep it <= PN_MAX_PAYLOAD and/or chunk.)
-
+    // no NVS key/value format is defined for it yet: say so instead of a hollow ok
+    sendExecAck(c.seq, false, pnow::ERR_NOT_SUPPORTED, 0);
+    Serial.println("[PNOW] WRITE not supported");
     break;
   }
 
-  case pnow::CMD_WRITE:
+  case pnow::CMD_CHANNEL:
   {
-    sendAck(h.seq, true, pnow::ERR_OK, 0);
-    Serial.println("[PNOW] WRITE");
-
-    // TODO: implement write routine here
-
+    pnow::ChannelPayload cp{};
+    if (c.len < sizeof(cp))
+    {
+      sendExecAck(c.seq, false, pnow::ERR_BAD_LEN, 0);
+      break;
+    }
+    memcpy(&cp, c.payload, sizeof(cp));
+    if (!pnow::channel_valid(cp.channel))
+    {
+      sendExecAck(c.seq, false, pnow::ERR_NOT_SUPPORTED, 0);
+      break;
+    }
+    // ack on the current channel; loop() retunes and persists
+    sendExecAck(c.seq, true, pnow::ERR_OK, cp.channel);
+    _announcedChannel = cp.channel;
+    Serial.printf("[PNOW] CHANNEL %u\n", cp.channel);
     break;
   }
 
   case pnow::CMD_OTA:
   {
     Serial.println("[PNOW] OTA");
-    // ACK immediately: "command in progress"
-    sendAck(h.seq, true, pnow::ERR_OK, 0);
-
     // payload = URL as bytes (not necessarily null-terminated)
-    if (h.len == 0 || h.len > pnow::PN_MAX_PAYLOAD)
+    if (c.len == 0)
     {
+      sendExecAck(c.seq, false, pnow::ERR_BAD_LEN, 0);
       Serial.println("[PNOW] OTA missing url payload");
       break;
     }
+    // ACK before the download: "command in progress"
+    sendExecAck(c.seq, true, pnow::ERR_OK, 0);
 
     String url;
-    url.reserve(h.len + 1);
-    for (uint16_t i = 0; i < h.len; i++)
-      url += (char)payload[i];
+    url.reserve(c.len + 1);
+    for (uint16_t i = 0; i < c.len; i++)
+      url += (char)c.payload[i];
 
     Serial.println("[PNOW] OTA start");
     handleOtaCommand(url);
-
     break;
   }
 
   default:
-    sendAck(h.seq, false, pnow::ERR_NOT_SUPPORTED, 0);
+    sendExecAck(c.seq, false, pnow::ERR_NOT_SUPPORTED, 0);
     break;
   }
 }
@@ -527,10 +950,8 @@ void ProbeRunService::handleOtaCommand(const String &url)
   Serial.print("[PNOW][OTA] url=");
   Serial.println(url);
 
-  // Stop ESPNOW link before WiFi connect/HTTP
-  _link.end();
-  delay(50);
-
+  // ESP-NOW stays up: once associated, the radio is on the AP's channel, which is the
+  // gateway's, so pushes keep flowing during the download
   auto r = _ota.runProbe(url, nullptr);
 
   if (r == OtaService::Result::Ok)
@@ -542,6 +963,6 @@ void ProbeRunService::handleOtaCommand(const String &url)
   Serial.print("[PNOW][OTA] failed code=");
   Serial.println((int)r);
 
-  // Re-init ESPNOW link from cached config (ensureEspNow handles WiFi disconnect internally)
-  ensureEspNow();
+  // OTA turned WiFi off on failure: loop() owns the link and restarts it
+  _linkRestart = true;
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <time.h>
 #include <inttypes.h>
 #include <ArduinoJson.h>
+#include <vector>
 #ifndef FW_VERSION
 #define FW_VERSION "0.0.0"
 #endif
@@ -16,7 +17,7 @@ const char* firmwareVersion = FW_VERSION;
 RunService *RunService::_self = nullptr;
 
 RunService::RunService(PreferenceService &prefs, MqttService &mqtt, const Config &cfg)
-    : _prefs(prefs), _mqtt(mqtt), _cfg(cfg), _esp(), _ota(_prefs)
+    : _prefs(prefs), _mqtt(mqtt), _cfg(cfg), _esp(_prefs), _ota(_prefs)
 {
   _self = this;
 }
@@ -31,6 +32,17 @@ void RunService::begin()
   {
     Serial.println("[ESPNOW] ready");
     loadTopologyFromNvs();
+    _esp.setRtoBounds(_cfg.espnowRtoMinMs, _cfg.espnowRtoMaxMs);
+    _esp.setBreaker(_cfg.espnowBreakerThreshold, _cfg.espnowBreakerOpenMs);
+    if (_cfg.espnowRssiSniffer)
+      _esp.setRssiSniffer(true);
+    _esp.setPresenceCallback([this](const uint8_t mac[6], bool online, int8_t rssi)
+                             { publishPresence(mac, online, rssi); },
+                             _cfg.probeOfflineAfterMs);
+    _esp.setPushCallback([this](const uint8_t mac[6], const EspNowService::TelemetryResponse &r)
+                         { publishPushedTelemetry(mac, r); });
+    // refresh every snapshot before it ages out of the TelemetryDevice cache, at any fleet size
+    _esp.setPollInterval(_cfg.probePollEveryMs, _cfg.espnowTimeoutMs, 0, _cfg.telemetryMaxAgeMs / 4 * 3);
   }
   else
   {
@@ -94,6 +106,7 @@ void RunService::loop()
 
   // ESPNOW task loop (timeouts / queue)
   _esp.loop();
+  pumpFanOut();
 
   // Register retry until confirmed
   if (!_registerConfirmed)
@@ -109,6 +122,7 @@ void RunService::loop()
   {
     publishStatusIfDue();
     publishTelemetryIfDue();
+    publishMetricsIfDue();
   }
 }
 
@@ -305,6 +319,9 @@ void RunService::publishRegister()
   doc["firmwareVersion"] = firmwareVersion; // keep your existing value if you patch later
   doc["macAddress"] = WiFi.macAddress();
   doc["wifiSsid"] = WiFi.SSID();
+  // lets the cloud answer "unchanged" or a delta instead of the full probe list
+  doc["topologyHash"] = topologyHash();
+  doc["probeCount"] = _esp.peerCount();
 
   String payload;
   serializeJson(doc, payload);
@@ -332,6 +349,8 @@ void RunService::publishStatusIfDue()
   doc["wifi"] = (WiFi.status() == WL_CONNECTED);
   doc["rssi"] = WiFi.RSSI();
   doc["heap"] = ESP.getFreeHeap();
+  doc["espnowDriverPeers"] = _esp.driverPeerCount();
+  doc["espnowEvictions"] = _esp.driverEvictions();
 
   String payload;
   serializeJson(doc, payload);
@@ -346,16 +365,52 @@ void RunService::publishStatusIfDue()
   Serial.println(ok ? "true" : "false");
 }
 
-void RunService::publishTelemetryIfDue()
+void RunService::publishPresence(const uint8_t mac[6], bool online, int8_t rssi)
 {
-  uint32_t nowMs = millis();
-  if (nowMs - _lastTelemetryMs < _cfg.telemetryEveryMs)
+  // edges only; a missed one is corrected by the next telemetry publish (online per probe)
+  if (!_mqtt.connected() || !_registerConfirmed)
+    return;
+
+  JsonDocument doc;
+  doc["macAddress"] = EspNowService::macToString(mac);
+  doc["online"] = online;
+  if (rssi != 0)
+    doc["rssi"] = rssi;
+
+  EspNowService::Liveness lv;
+  if (_esp.getLiveness(mac, lv))
+  {
+    doc["lastSeenAgoMs"] = lv.lastSeenAgoMs;
+    doc["heartbeats"] = lv.heartbeats;
+    doc["maxHeartbeatGapMs"] = lv.maxGapMs;
+  }
+
+  String payload;
+  serializeJson(doc, payload);
+
+  const String t = topicOf("probe/presence");
+  bool ok = _mqtt.publish(t.c_str(), payload.c_str());
+  Serial.print("PUB -> ");
+  Serial.print(t);
+  Serial.print(" ok=");
+  Serial.println(ok ? "true" : "false");
+}
+
+void RunService::publishPushedTelemetry(const uint8_t mac[6], const EspNowService::TelemetryResponse &r)
+{
+  // the snapshot is updated either way; the periodic telemetry publish catches up later
+  if (!_mqtt.connected() || !_registerConfirmed)
     return;
-  _lastTelemetryMs = nowMs;
 
-  // Keep current behavior: publish a heartbeat telemetry (real probe data comes via ESPNOW requests)
   JsonDocument doc;
   doc["alive"] = true;
+  doc["probeCount"] = _esp.peerCount();
+  doc["push"] = true;
+
+  JsonObject o = doc["probes"].to<JsonArray>().add<JsonObject>();
+  o["macAddress"] = EspNowService::macToString(mac);
+  writeProbeTelemetry(o, r);
+  o["ageMs"] = 0;
 
   String payload;
   serializeJson(doc, payload);
@@ -368,6 +423,160 @@ void RunService::publishTelemetryIfDue()
   Serial.println(ok ? "true" : "false");
 }
 
+void RunService::publishMetricsIfDue()
+{
+  if (_cfg.metricsEveryMs == 0)
+    return;
+  uint32_t nowMs = millis();
+  if (nowMs - _lastMetricsMs < _cfg.metricsEveryMs)
+    return;
+  _lastMetricsMs = nowMs;
+  publishMetrics(String(""));
+}
+
+void RunService::publishMetrics(const String &correlationId)
+{
+  const uint16_t count = _esp.peerCount();
+  const uint16_t pages = count == 0 ? 1 : (count + METRICS_PAGE_SIZE - 1) / METRICS_PAGE_SIZE;
+  const String t = topicOf("espnow/metrics");
+  const EspNowTx::Stats tx = _esp.txStats();
+
+  for (uint16_t page = 0; page < pages; page++)
+  {
+    JsonDocument doc;
+    if (correlationId.length() > 0)
+      doc["correlationId"] = correlationId;
+    doc["probeCount"] = count;
+    if (pages > 1)
+    {
+      doc["page"] = page;
+      doc["pages"] = pages;
+    }
+
+    // gateway-wide radio counters + histogram layout, once per page so each stands alone
+    JsonObject txo = doc["tx"].to<JsonObject>();
+    txo["sent"] = tx.sent;
+    txo["delivered"] = tx.delivered;
+    txo["failed"] = tx.failed;
+    txo["retries"] = tx.retries;
+    txo["dropped"] = tx.dropped;
+    JsonArray limits = doc["rttBucketsMs"].to<JsonArray>();
+    for (uint8_t b = 0; b + 1 < EspNowService::RTT_BUCKETS; b++)
+      limits.add(EspNowService::rttBucketLimitMs(b));
+
+    JsonArray arr = doc["probes"].to<JsonArray>();
+    const uint16_t end = min<uint16_t>(count, (page + 1) * METRICS_PAGE_SIZE);
+    for (uint16_t i = page * METRICS_PAGE_SIZE; i < end; i++)
+    {
+      const EspNowService::Peer *p = _esp.peerAt(i);
+      EspNowService::LinkStats ls;
+      if (!p || !_esp.getLinkStats(p->mac, ls))
+        continue;
+
+      JsonObject o = arr.add<JsonObject>();
+      o["macAddress"] = EspNowService::macToString(p->mac);
+      o["requests"] = ls.requests;
+      o["responses"] = ls.responses;
+      o["timeouts"] = ls.timeouts;
+      o["retries"] = ls.retries;
+      o["txOk"] = ls.delivered;
+      o["txFail"] = ls.failed;
+      if (ls.delivered + ls.failed > 0)
+        o["txLossPct"] = (float)(100.0 * ls.failed / (ls.delivered + ls.failed));
+      if (ls.srttMs > 0)
+        o["srttMs"] = ls.srttMs;
+      JsonArray hist = o["rttHist"].to<JsonArray>();
+      for (uint8_t b = 0; b < EspNowService::RTT_BUCKETS; b++)
+        hist.add(ls.rttHist[b]);
+      if (ls.rssiLast != 0)
+      {
+        o["rssi"] = ls.rssiLast;
+        o["rssiAvg"] = ls.rssiAvg;
+      }
+    }
+
+    String payload;
+    serializeJson(doc, payload);
+
+    bool ok = _mqtt.publish(t.c_str(), payload.c_str());
+    Serial.print("PUB -> ");
+    Serial.print(t);
+    Serial.print(" ok=");
+    Serial.println(ok ? "true" : "false");
+  }
+}
+
+void RunService::publishTelemetryIfDue()
+{
+  uint32_t nowMs = millis();
+  if (nowMs - _lastTelemetryMs < _cfg.telemetryEveryMs)
+    return;
+  _lastTelemetryMs = nowMs;
+
+  // heartbeat + latest cached probe telemetry (filled by the background poller)
+  static uint8_t macs[EspNowService::MAX_PEERS][6];
+  uint16_t cached = 0;
+  for (uint16_t i = 0; i < _esp.peerCount(); i++)
+  {
+    EspNowService::TelemetryResponse r;
+    uint32_t ageMs = 0;
+    if (_esp.getSnapshot(_esp.peerAt(i)->mac, r, ageMs))
+      memcpy(macs[cached++], _esp.peerAt(i)->mac, 6);
+  }
+
+  const uint16_t pages = cached == 0 ? 1 : (cached + PROBE_PAGE_SIZE - 1) / PROBE_PAGE_SIZE;
+  const String t = topicOf("telemetry");
+  for (uint16_t page = 0; page < pages; page++)
+  {
+    JsonDocument doc;
+    doc["alive"] = true;
+    doc["probeCount"] = _esp.peerCount();
+    if (pages > 1)
+    {
+      doc["page"] = page;
+      doc["pages"] = pages;
+    }
+
+    JsonArray arr = doc["probes"].to<JsonArray>();
+    const uint16_t end = min<uint16_t>(cached, (page + 1) * PROBE_PAGE_SIZE);
+    for (uint16_t i = page * PROBE_PAGE_SIZE; i < end; i++)
+    {
+      EspNowService::TelemetryResponse r;
+      uint32_t ageMs = 0;
+      if (!_esp.getSnapshot(macs[i], r, ageMs))
+        continue;
+      JsonObject o = arr.add<JsonObject>();
+      o["macAddress"] = EspNowService::macToString(macs[i]);
+      writeProbeTelemetry(o, r);
+      o["ageMs"] = ageMs;
+
+      EspNowService::LinkStats ls;
+      if (_esp.getLinkStats(macs[i], ls))
+      {
+        o["txOk"] = ls.delivered;
+        o["txFail"] = ls.failed;
+      }
+
+      EspNowService::Liveness lv;
+      if (_esp.getLiveness(macs[i], lv))
+      {
+        o["online"] = lv.online;
+        if (lv.rssi != 0)
+          o["rssi"] = lv.rssi;
+      }
+    }
+
+    String payload;
+    serializeJson(doc, payload);
+
+    bool ok = _mqtt.publish(t.c_str(), payload.c_str());
+    Serial.print("PUB -> ");
+    Serial.print(t);
+    Serial.print(" ok=");
+    Serial.println(ok ? "true" : "false");
+  }
+}
+
 // -------------------- MQTT Static bridges --------------------
 void RunService::onRegisterConfirmStatic(char *topic, byte *payload, unsigned int length)
 {
@@ -462,50 +671,30 @@ void RunService::onTopologyResult(char *topic, byte *payload, unsigned int lengt
   Serial.print("] ");
   Serial.println(body);
 
-  // persist raw JSON
-  _prefs.saveTopologyJson(body);
-
   JsonDocument doc;
-  auto err = deserializeJson(doc, body);
-  if (err)
+  if (deserializeJson(doc, body))
     return;
 
-  JsonArray probes = doc["Probes"].as<JsonArray>();
-  if (probes.isNull())
-    probes = doc["probes"].as<JsonArray>();
-  if (probes.isNull())
+  if (doc["unchanged"].is<bool>() && doc["unchanged"].as<bool>())
+  {
+    Serial.println("[TOPOLOGY] unchanged");
     return;
+  }
 
-  uint32_t added = 0;
-  for (JsonVariant v : probes)
+  if (!doc["add"].isNull() || !doc["remove"].isNull())
   {
-    const char *macRaw = v["MacAddress"].is<const char *>() ? v["MacAddress"].as<const char *>() : v["macAddress"].as<const char *>();
-    const char *lmkRaw = v["Lmk"].is<const char *>() ? v["Lmk"].as<const char *>() : v["lmk"].as<const char *>();
-    const char *dkeyRaw = v["DeviceKey"].is<const char *>() ? v["DeviceKey"].as<const char *>() : v["deviceKey"].as<const char *>();
-
-    if (!macRaw)
-      continue;
-
-    String macStr(macRaw);
-    String lmkHex = lmkRaw ? String(lmkRaw) : String("");
-    String dkey = dkeyRaw ? String(dkeyRaw) : String("");
-
-    uint8_t mac[6];
-    if (!EspNowService::parseMac(macStr, mac))
-      continue;
-
-    EspNowService::Peer p;
-    memcpy(p.mac, mac, 6);
-    p.deviceKey = dkey;
+    applyTopologyDelta(doc);
+    return;
+  }
 
-    if (lmkHex.length() == 32 && EspNowService::hexTo16(lmkHex, p.lmk))
-    {
-      p.hasLmk = true;
-    }
+  bool ok = false;
+  uint32_t added = applyTopologyFull(doc, ok);
+  if (!ok)
+    return;
 
-    _esp.upsertPeer(p);
-    added++;
-  }
+  // persist the compiled table, not the JSON
+  if (!saveTopologyBlob())
+    Serial.println("[TOPOLOGY] failed to persist peer table");
 
   Serial.print("[TOPOLOGY] stored. peers updated: ");
   Serial.println(added);
@@ -579,6 +768,35 @@ void RunService::onCommand(char *topic, byte *payload, unsigned int length)
     return;
   }
 
+  if (cmd == "EspNowMetrics")
+  {
+    JsonDocument ack;
+    ack["correlationId"] = correlationId;
+    ack["ok"] = true;
+    ack["status"] = "running";
+
+    String out;
+    serializeJson(ack, out);
+    const String tAck = topicOf("command/ack");
+    _mqtt.publish(tAck.c_str(), out.c_str());
+
+    publishMetrics(correlationId);
+    return;
+  }
+
+  if (cmd == "TelemetryAll")
+  {
+    handleTelemetryAll(correlationId, doc["macAddresses"].as<JsonArrayConst>(), commandDeadlineMs(doc));
+    return;
+  }
+
+  if (cmd == "StatusDevice" || cmd == "TareDevice" || cmd == "RebootDevice" || cmd == "ResetDevice" ||
+      cmd == "OtaDevice")
+  {
+    handleProbeCommand(cmd, correlationId, doc);
+    return;
+  }
+
   if (cmd != "TelemetryDevice")
   {
     // keep other commands as-is (ignored here)
@@ -600,7 +818,7 @@ void RunService::onCommand(char *topic, byte *payload, unsigned int length)
   }
 
   uint8_t mac[6];
-  if (correlationId.length() != 32 || !EspNowService::parseMac(macStr, mac))
+  if (!EspNowService::parseMac(macStr, mac))
   {
     JsonDocument res;
     res["correlationId"] = correlationId;
@@ -615,9 +833,25 @@ void RunService::onCommand(char *topic, byte *payload, unsigned int length)
     return;
   }
 
+  // serve from the poller cache when fresh enough ("live": true forces a radio exchange)
+  const bool live = doc["live"].is<bool>() && doc["live"].as<bool>();
+  EspNowService::TelemetryResponse cachedResp;
+  uint32_t ageMs = 0;
+  if (!live && _esp.getSnapshot(mac, cachedResp, ageMs) && ageMs <= _cfg.telemetryMaxAgeMs)
+  {
+    JsonDocument res;
+    res["correlationId"] = correlationId;
+    res["macAddress"] = macStr;
+    res["ok"] = true;
+    writeProbeTelemetry(res.as<JsonObject>(), cachedResp);
+    res["cached"] = true;
+    res["ageMs"] = ageMs;
+    publishCommandResult(res);
+    return;
+  }
+
   bool queued = _esp.requestTelemetryByMac(
       mac,
-      correlationId,
       [this, correlationId, macStr](const EspNowService::TelemetryResponse &r)
       {
         JsonDocument res;
@@ -626,26 +860,15 @@ void RunService::onCommand(char *topic, byte *payload, unsigned int length)
         res["ok"] = r.ok;
 
         if (r.ok)
-        {
-          res["uid"] = r.uid;
-          res["weight"] = r.weight;
-          res["variance"] = r.variance;
-          res["tagAtMs"] = r.tagAtMs;
-          res["weightAtMs"] = r.weightAtMs;
-        }
+          writeProbeTelemetry(res.as<JsonObject>(), r);
         else
-        {
-          res["error"] = "timeout";
-        }
-
-        String out;
-        serializeJson(res, out);
+          res["error"] = EspNowService::errorName(r.error);
 
-        const String tRes = topicOf("command/result");
-        _mqtt.publish(tRes.c_str(), out.c_str());
+        publishCommandResult(res);
       },
       _cfg.espnowTimeoutMs,
-      _cfg.espnowRetries);
+      _cfg.espnowRetries,
+      commandDeadlineMs(doc));
 
   if (!queued)
   {
@@ -662,51 +885,558 @@ void RunService::onCommand(char *topic, byte *payload, unsigned int length)
   }
 }
 
+// StatusDevice / TareDevice / RebootDevice / ResetDevice / OtaDevice -> pnow command to one probe
+void RunService::handleProbeCommand(const String &cmd, const String &correlationId, const JsonDocument &doc)
+{
+  const String macStr = doc["macAddress"].is<const char *>() ? String(doc["macAddress"].as<const char *>()) : String("");
+
+  pnow::MsgType type = pnow::CMD_STATUS;
+  if (cmd == "TareDevice")
+    type = pnow::CMD_TARE;
+  else if (cmd == "RebootDevice")
+    type = pnow::CMD_REBOOT;
+  else if (cmd == "ResetDevice")
+    type = pnow::CMD_RESET;
+  else if (cmd == "OtaDevice")
+    type = pnow::CMD_OTA;
+
+  // OTA payload = URL bytes
+  const String url =
+      doc["url"].is<const char *>() ? String(doc["url"].as<const char *>())
+                                    : (doc["Url"].is<const char *>() ? String(doc["Url"].as<const char *>()) : String(""));
+
+  // ACK immediately
+  {
+    JsonDocument ack;
+    ack["correlationId"] = correlationId;
+    ack["ok"] = true;
+    String out;
+    serializeJson(ack, out);
+
+    const String tAck = topicOf("command/ack");
+    _mqtt.publish(tAck.c_str(), out.c_str());
+  }
+
+  uint8_t mac[6];
+  bool argsOk = EspNowService::parseMac(macStr, mac);
+  if (type == pnow::CMD_OTA && (url.length() == 0 || url.length() > pnow::PN_MAX_PAYLOAD))
+    argsOk = false;
+  if (!argsOk)
+  {
+    JsonDocument res;
+    res["correlationId"] = correlationId;
+    res["macAddress"] = macStr;
+    res["ok"] = false;
+    res["error"] = "bad_args";
+    publishCommandResult(res);
+    return;
+  }
+
+  const uint8_t *payload = type == pnow::CMD_OTA ? (const uint8_t *)url.c_str() : nullptr;
+  const uint16_t len = type == pnow::CMD_OTA ? (uint16_t)url.length() : 0;
+
+  bool queued = _esp.sendCommand(
+      mac,
+      type,
+      payload,
+      len,
+      [this, correlationId, macStr](const EspNowService::CommandResponse &r)
+      {
+        JsonDocument res;
+        res["correlationId"] = correlationId;
+        res["macAddress"] = macStr;
+        res["ok"] = r.ok;
+
+        if (r.ok && r.hasStatus)
+        {
+          res["uptimeS"] = r.uptimeS;
+          res["lastWeight"] = r.lastWeight;
+          res["flags"] = r.statusFlags;
+        }
+        if (!r.ok)
+        {
+          res["error"] = EspNowService::errorName(r.error);
+          if (r.error == EspNowService::Error::Rejected)
+            res["probeError"] = EspNowService::probeErrName(r.probeErr);
+        }
+
+        publishCommandResult(res);
+      },
+      _cfg.espnowTimeoutMs,
+      _cfg.espnowRetries,
+      commandDeadlineMs(doc));
+
+  if (!queued)
+  {
+    JsonDocument res;
+    res["correlationId"] = correlationId;
+    res["macAddress"] = macStr;
+    res["ok"] = false;
+    res["error"] = "queue_full";
+    publishCommandResult(res);
+  }
+}
+
+uint32_t RunService::commandDeadlineMs(const JsonDocument &doc)
+{
+  return doc["deadlineMs"].is<uint32_t>() ? doc["deadlineMs"].as<uint32_t>() : 0;
+}
+
+void RunService::publishCommandResult(const JsonDocument &doc)
+{
+  String out;
+  serializeJson(doc, out);
+  const String tRes = topicOf("command/result");
+  _mqtt.publish(tRes.c_str(), out.c_str());
+}
+
+void RunService::writeProbeTelemetry(JsonObject o, const EspNowService::TelemetryResponse &r)
+{
+  o["uid"] = r.uid;
+  o["weight"] = r.weight;
+  o["variance"] = r.variance;
+  o["tagAtMs"] = r.tagAtMs;
+  o["weightAtMs"] = r.weightAtMs;
+}
+
+// -------------------- TelemetryAll fan-out --------------------
+void RunService::handleTelemetryAll(const String &correlationId, JsonArrayConst macs, uint32_t deadlineMs)
+{
+  // ACK immediately
+  {
+    JsonDocument ack;
+    ack["correlationId"] = correlationId;
+    ack["ok"] = !_fanOut.active;
+    if (_fanOut.active)
+      ack["error"] = "busy";
+    String out;
+    serializeJson(ack, out);
+
+    const String tAck = topicOf("command/ack");
+    _mqtt.publish(tAck.c_str(), out.c_str());
+  }
+
+  if (_fanOut.active)
+    return;
+
+  _fanOut.correlationId = correlationId;
+  _fanOut.hasDeadline = deadlineMs > 0;
+  _fanOut.deadlineAtMs = millis() + deadlineMs;
+  _fanOut.count = 0;
+  _fanOut.submitted = 0;
+  _fanOut.done = 0;
+
+  if (!macs.isNull())
+  {
+    // explicit list (unknown MACs are polled too, unencrypted)
+    for (JsonVariantConst v : macs)
+    {
+      if (_fanOut.count >= EspNowService::MAX_PEERS)
+        break;
+      uint8_t mac[6];
+      if (!v.is<const char *>() || !EspNowService::parseMac(String(v.as<const char *>()), mac))
+        continue;
+      _fanOut.probes[_fanOut.count] = FanOutProbe{};
+      memcpy(_fanOut.probes[_fanOut.count].mac, mac, 6);
+      _fanOut.count++;
+    }
+  }
+  else
+  {
+    for (uint16_t i = 0; i < _esp.peerCount(); i++)
+    {
+      _fanOut.probes[_fanOut.count] = FanOutProbe{};
+      memcpy(_fanOut.probes[_fanOut.count].mac, _esp.peerAt(i)->mac, 6);
+      _fanOut.count++;
+    }
+  }
+
+  Serial.print("[FANOUT] TelemetryAll probes=");
+  Serial.println(_fanOut.count);
+
+  _fanOut.active = true;
+  pumpFanOut();
+}
+
+void RunService::pumpFanOut()
+{
+  if (!_fanOut.active)
+    return;
+
+  while (_fanOut.submitted < _fanOut.count)
+  {
+    const uint16_t idx = _fanOut.submitted;
+
+    // probes still waiting for a queue slot share the command's remaining budget
+    uint32_t budgetMs = 0;
+    if (_fanOut.hasDeadline)
+    {
+      int32_t left = (int32_t)(_fanOut.deadlineAtMs - millis());
+      if (left <= 0)
+      {
+        FanOutProbe &p = _fanOut.probes[idx];
+        p.done = true;
+        p.r = EspNowService::TelemetryResponse{};
+        p.r.error = EspNowService::Error::DeadlineExceeded;
+        _fanOut.done++;
+        _fanOut.submitted++;
+        continue;
+      }
+      budgetMs = (uint32_t)left;
+    }
+
+    bool queued = _esp.requestTelemetryByMac(
+        _fanOut.probes[idx].mac,
+        [this, idx](const EspNowService::TelemetryResponse &r)
+        {
+          FanOutProbe &p = _fanOut.probes[idx];
+          p.done = true;
+          p.r = r;
+          _fanOut.done++;
+        },
+        _cfg.espnowTimeoutMs,
+        _cfg.espnowRetries,
+        budgetMs);
+
+    if (!queued)
+      break; // queue full: retry on next loop
+    _fanOut.submitted++;
+  }
+
+  if (_fanOut.done >= _fanOut.count)
+  {
+    publishFanOutResult();
+    _fanOut.active = false;
+  }
+}
+
+void RunService::publishFanOutResult()
+{
+  uint16_t okCount = 0;
+  for (uint16_t i = 0; i < _fanOut.count; i++)
+    if (_fanOut.probes[i].r.ok)
+      okCount++;
+
+  const uint16_t pages = _fanOut.count == 0 ? 1 : (_fanOut.count + PROBE_PAGE_SIZE - 1) / PROBE_PAGE_SIZE;
+  for (uint16_t page = 0; page < pages; page++)
+  {
+    JsonDocument res;
+    res["correlationId"] = _fanOut.correlationId;
+    res["ok"] = true;
+    res["total"] = _fanOut.count;
+    res["okCount"] = okCount;
+    res["page"] = page;
+    res["pages"] = pages;
+
+    JsonArray arr = res["probes"].to<JsonArray>();
+    const uint16_t end = min<uint16_t>(_fanOut.count, (page + 1) * PROBE_PAGE_SIZE);
+    for (uint16_t i = page * PROBE_PAGE_SIZE; i < end; i++)
+    {
+      const FanOutProbe &p = _fanOut.probes[i];
+      JsonObject o = arr.add<JsonObject>();
+      o["macAddress"] = EspNowService::macToString(p.mac);
+      o["ok"] = p.r.ok;
+      if (p.r.ok)
+        writeProbeTelemetry(o, p.r);
+      else
+        o["error"] = EspNowService::errorName(p.r.error);
+    }
+
+    publishCommandResult(res);
+  }
+
+  Serial.print("[FANOUT] done ok=");
+  Serial.print(okCount);
+  Serial.print("/");
+  Serial.println(_fanOut.count);
+}
+
 void RunService::loadTopologyFromNvs()
 {
+  uint16_t loaded = 0;
+  if (loadTopologyBlob(loaded))
+  {
+    Serial.print("[ESPNOW] peers loaded from NVS: ");
+    Serial.println(loaded);
+    return;
+  }
+
+  // topology stored as raw JSON by older firmware: compile it once
   String json = _prefs.loadTopologyJson();
   if (json.length() == 0)
     return;
 
-  JsonDocument doc;
-  auto err = deserializeJson(doc, json);
-  if (err)
+  bool ok = false;
+  uint32_t added = 0;
+  {
+    JsonDocument doc;
+    if (deserializeJson(doc, json))
+      return;
+    added = applyTopologyFull(doc, ok);
+  }
+  if (!ok)
     return;
 
-  JsonArray probes = doc["Probes"].as<JsonArray>();
+  if (saveTopologyBlob())
+    _prefs.clearTopologyJson();
+
+  Serial.print("[ESPNOW] peers migrated from topology JSON: ");
+  Serial.println(added);
+}
+
+bool RunService::saveTopologyBlob()
+{
+  const uint16_t count = _esp.peerCount();
+
+  std::vector<uint8_t> buf;
+  buf.reserve(sizeof(TopoBlobHeader) + count * (8 + 16 + EspNowService::DEVICE_KEY_MAX));
+  buf.resize(sizeof(TopoBlobHeader));
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    const EspNowService::Peer *p = _esp.peerAt(i);
+    const uint8_t keyLen = (uint8_t)strnlen(p->deviceKey, EspNowService::DEVICE_KEY_MAX - 1);
+
+    buf.insert(buf.end(), p->mac, p->mac + 6);
+    buf.push_back(p->hasLmk ? TOPO_FLAG_LMK : 0);
+    buf.push_back(keyLen);
+    if (p->hasLmk)
+      buf.insert(buf.end(), p->lmk, p->lmk + 16);
+    buf.insert(buf.end(), (const uint8_t *)p->deviceKey, (const uint8_t *)p->deviceKey + keyLen);
+  }
+
+  TopoBlobHeader h{};
+  h.magic = TOPO_MAGIC;
+  h.version = TOPO_VERSION;
+  h.count = count;
+  h.crc32 = pnow::crc32_update(0, buf.data() + sizeof(h), buf.size() - sizeof(h));
+  memcpy(buf.data(), &h, sizeof(h));
+
+  return _prefs.saveTopologyBlob(buf.data(), buf.size());
+}
+
+bool RunService::loadTopologyBlob(uint16_t &loaded)
+{
+  loaded = 0;
+
+  const size_t n = _prefs.topologyBlobLength();
+  if (n < sizeof(TopoBlobHeader))
+    return false;
+
+  std::vector<uint8_t> buf(n);
+  if (_prefs.loadTopologyBlob(buf.data(), n) != n)
+    return false;
+
+  TopoBlobHeader h{};
+  memcpy(&h, buf.data(), sizeof(h));
+  if (h.magic != TOPO_MAGIC || h.version != TOPO_VERSION)
+  {
+    Serial.println("[TOPOLOGY] stored peer table has an unknown format, ignored");
+    return false;
+  }
+
+  const uint8_t *rec = buf.data() + sizeof(h);
+  const size_t recLen = n - sizeof(h);
+  if (pnow::crc32_update(0, rec, recLen) != h.crc32)
+  {
+    Serial.println("[TOPOLOGY] stored peer table CRC mismatch, ignored");
+    return false;
+  }
+
+  size_t off = 0;
+  for (uint16_t i = 0; i < h.count; i++)
+  {
+    if (off + 8 > recLen)
+      return false;
+
+    EspNowService::Peer p;
+    memcpy(p.mac, rec + off, 6);
+    p.hasLmk = (rec[off + 6] & TOPO_FLAG_LMK) != 0;
+    const uint8_t keyLen = rec[off + 7];
+    off += 8;
+
+    if (keyLen >= EspNowService::DEVICE_KEY_MAX || off + (p.hasLmk ? 16 : 0) + keyLen > recLen)
+      return false;
+    if (p.hasLmk)
+    {
+      memcpy(p.lmk, rec + off, 16);
+      off += 16;
+    }
+    memcpy(p.deviceKey, rec + off, keyLen);
+    p.deviceKey[keyLen] = '\0';
+    off += keyLen;
+
+    if (_esp.upsertPeer(p))
+      loaded++;
+  }
+  return true;
+}
+
+bool RunService::parseTopologyProbe(JsonVariantConst v, EspNowService::Peer &out)
+{
+  const char *macRaw = v["MacAddress"].is<const char *>() ? v["MacAddress"].as<const char *>() : v["macAddress"].as<const char *>();
+  const char *lmkRaw = v["Lmk"].is<const char *>() ? v["Lmk"].as<const char *>() : v["lmk"].as<const char *>();
+  const char *dkeyRaw = v["DeviceKey"].is<const char *>() ? v["DeviceKey"].as<const char *>() : v["deviceKey"].as<const char *>();
+
+  if (!macRaw)
+    return false;
+
+  String lmkHex = lmkRaw ? String(lmkRaw) : String("");
+  String dkey = dkeyRaw ? String(dkeyRaw) : String("");
+
+  out = EspNowService::Peer{};
+  if (!EspNowService::parseMac(String(macRaw), out.mac))
+    return false;
+  out.setDeviceKey(dkey);
+  if (lmkHex.length() == 32 && EspNowService::hexTo16(lmkHex, out.lmk))
+    out.hasLmk = true;
+  return true;
+}
+
+static int32_t indexOfMac(const uint8_t (*macs)[6], uint16_t count, const uint8_t mac[6])
+{
+  for (uint16_t k = 0; k < count; k++)
+  {
+    if (memcmp(macs[k], mac, 6) == 0)
+      return k;
+  }
+  return -1;
+}
+
+uint32_t RunService::applyTopologyFull(const JsonDocument &doc, bool &ok)
+{
+  ok = false;
+
+  JsonArrayConst probes = doc["Probes"].as<JsonArrayConst>();
   if (probes.isNull())
-    probes = doc["probes"].as<JsonArray>();
+    probes = doc["probes"].as<JsonArrayConst>();
   if (probes.isNull())
-    return;
+    return 0;
 
-  uint32_t added = 0;
-  for (JsonVariant v : probes)
-  {
-    const char *macRaw = v["MacAddress"].is<const char *>() ? v["MacAddress"].as<const char *>() : v["macAddress"].as<const char *>();
-    const char *lmkRaw = v["Lmk"].is<const char *>() ? v["Lmk"].as<const char *>() : v["lmk"].as<const char *>();
-    const char *dkeyRaw = v["DeviceKey"].is<const char *>() ? v["DeviceKey"].as<const char *>() : v["deviceKey"].as<const char *>();
+  ok = true;
 
-    if (!macRaw)
+  // distinct MACs listed by this topology (at most a full table: the rest could not fit)
+  static uint8_t listed[EspNowService::MAX_PEERS][6];
+  static bool upserted[EspNowService::MAX_PEERS];
+  uint16_t listedCount = 0;
+  for (JsonVariantConst v : probes)
+  {
+    EspNowService::Peer p;
+    if (!parseTopologyProbe(v, p) || indexOfMac(listed, listedCount, p.mac) >= 0)
       continue;
+    if (listedCount == EspNowService::MAX_PEERS)
+    {
+      Serial.println("[TOPOLOGY] more probes than the peer table holds, rest ignored");
+      break;
+    }
+    memcpy(listed[listedCount], p.mac, 6);
+    upserted[listedCount] = false;
+    listedCount++;
+  }
 
-    String macStr(macRaw);
-    String lmkHex = lmkRaw ? String(lmkRaw) : String("");
-    String dkey = dkeyRaw ? String(dkeyRaw) : String("");
+  // prune first, so probes that replace others find a free slot
+  // (walk backwards: removal moves the last record into the hole)
+  uint32_t removed = 0;
+  for (int32_t i = (int32_t)_esp.peerCount() - 1; i >= 0; i--)
+  {
+    const EspNowService::Peer *p = _esp.peerAt((uint16_t)i);
+    if (indexOfMac(listed, listedCount, p->mac) < 0 && _esp.removePeer(p->mac))
+      removed++;
+  }
 
-    uint8_t mac[6];
-    if (!EspNowService::parseMac(macStr, mac))
+  uint32_t added = 0;
+  for (JsonVariantConst v : probes)
+  {
+    EspNowService::Peer p;
+    if (!parseTopologyProbe(v, p))
+      continue;
+    int32_t k = indexOfMac(listed, listedCount, p.mac);
+    if (k < 0)
+      continue;
+    if (!_esp.upsertPeer(p))
+    {
+      Serial.println("[TOPOLOGY] peer table full, probe ignored");
       continue;
+    }
+    // listed twice: the later entry wins, counted once
+    if (!upserted[k])
+    {
+      upserted[k] = true;
+      added++;
+    }
+  }
 
+  if (removed > 0)
+  {
+    Serial.print("[TOPOLOGY] peers removed: ");
+    Serial.println(removed);
+  }
+
+  return added;
+}
+
+void RunService::applyTopologyDelta(const JsonDocument &doc)
+{
+  const String baseHash = doc["baseHash"].is<const char *>() ? String(doc["baseHash"].as<const char *>()) : String("");
+  if (!baseHash.equalsIgnoreCase(topologyHash()))
+  {
+    // our table is not what the cloud diffed against: report the real hash, get a full list
+    Serial.println("[TOPOLOGY] delta base mismatch -> re-register");
+    publishRegister();
+    return;
+  }
+
+  uint32_t added = 0;
+  for (JsonVariantConst v : doc["add"].as<JsonArrayConst>())
+  {
     EspNowService::Peer p;
-    memcpy(p.mac, mac, 6);
-    p.deviceKey = dkey;
-    if (lmkHex.length() == 32 && EspNowService::hexTo16(lmkHex, p.lmk))
-      p.hasLmk = true;
+    if (!parseTopologyProbe(v, p))
+      continue;
+    if (_esp.upsertPeer(p))
+      added++;
+    else
+      Serial.println("[TOPOLOGY] peer table full, probe ignored");
+  }
 
-    _esp.upsertPeer(p);
-    added++;
+  uint32_t removed = 0;
+  for (JsonVariantConst v : doc["remove"].as<JsonArrayConst>())
+  {
+    uint8_t mac[6];
+    const char *macRaw = v.is<const char *>() ? v.as<const char *>() : v["macAddress"].as<const char *>();
+    if (macRaw && EspNowService::parseMac(String(macRaw), mac) && _esp.removePeer(mac))
+      removed++;
   }
 
-  Serial.print("[ESPNOW] peers loaded from NVS: ");
-  Serial.println(added);
+  if (!saveTopologyBlob())
+    Serial.println("[TOPOLOGY] failed to persist peer table");
+
+  Serial.print("[TOPOLOGY] delta applied: +");
+  Serial.print(added);
+  Serial.print(" -");
+  Serial.println(removed);
+
+  const String expected = doc["hash"].is<const char *>() ? String(doc["hash"].as<const char *>()) : String("");
+  if (expected.length() > 0 && !expected.equalsIgnoreCase(topologyHash()))
+  {
+    Serial.println("[TOPOLOGY] hash mismatch after delta -> re-register");
+    publishRegister();
+  }
+}
+
+String RunService::topologyHash() const
+{
+  static const uint8_t noLmk[16] = {};
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < _esp.peerCount(); i++)
+  {
+    const EspNowService::Peer *p = _esp.peerAt(i);
+    uint32_t crc = pnow::crc32_update(0, p->mac, 6);
+    crc = pnow::crc32_update(crc, p->hasLmk ? p->lmk : noLmk, 16);
+    crc = pnow::crc32_update(crc, (const uint8_t *)p->deviceKey, strnlen(p->deviceKey, sizeof(p->deviceKey)));
+    sum += crc;
+  }
+
+  char buf[9];
+  snprintf(buf, sizeof(buf), "%08lx", (unsigned long)sum);
+  return String(buf);
 }
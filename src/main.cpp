@@ -28,7 +28,23 @@ SetupService setupSvc(prefSvc, httpServer, setupCfg);
 
 #if defined(DEVICE_ROLE_PROBE)
 
-ProbeRunService::Config probeCfg;
+// HX711 wiring of the probe board (override with -D in build_flags, -1 = no load cell)
+#ifndef PROBE_SCALE_DOUT_PIN
+#define PROBE_SCALE_DOUT_PIN 16
+#endif
+#ifndef PROBE_SCALE_SCK_PIN
+#define PROBE_SCALE_SCK_PIN 4
+#endif
+
+static ProbeRunService::Config makeProbeConfig()
+{
+  ProbeRunService::Config cfg;
+  cfg.scaleDoutPin = PROBE_SCALE_DOUT_PIN;
+  cfg.scaleSckPin = PROBE_SCALE_SCK_PIN;
+  return cfg;
+}
+
+ProbeRunService::Config probeCfg = makeProbeConfig();
 ProbeRunService runSvc(prefSvc, probeCfg);
 
 static bool g_runtimeStarted = false;
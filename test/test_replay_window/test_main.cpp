@@ -0,0 +1,94 @@
+#include <unity.h>
+
+#include "ReplayWindow.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_reset_marks_everything_below_top_seen()
+{
+  ReplayWindow w;
+  w.reset(1000);
+  TEST_ASSERT_FALSE(w.check(1000));
+  TEST_ASSERT_FALSE(w.check(999));
+  TEST_ASSERT_FALSE(w.check(1000 - ReplayWindow::SIZE));
+  TEST_ASSERT_TRUE(w.check(1001));
+}
+
+static void test_out_of_order_inside_window()
+{
+  ReplayWindow w;
+  w.reset(1000);
+  w.mark(1005);
+  TEST_ASSERT_TRUE(w.check(1003));
+  w.mark(1003);
+  TEST_ASSERT_FALSE(w.check(1003));
+  TEST_ASSERT_TRUE(w.check(1004));
+  TEST_ASSERT_EQUAL_UINT32(1005, w.top());
+}
+
+// back = 63 is the last slot still tracked, back = 64 is too old to tell
+static void test_duplicate_at_window_edge()
+{
+  ReplayWindow w;
+  w.reset(1000);
+  w.mark(1100); // jump past the window: nothing below 1100 seen yet
+
+  const uint32_t edge = 1100 - (ReplayWindow::SIZE - 1);
+  TEST_ASSERT_TRUE(w.check(edge));
+  w.mark(edge);
+  TEST_ASSERT_FALSE(w.check(edge));
+  TEST_ASSERT_FALSE(w.check(edge - 1));
+
+  // one more step and the edge seq falls out: still rejected, now as too old
+  w.mark(1101);
+  TEST_ASSERT_FALSE(w.check(edge));
+  TEST_ASSERT_TRUE(w.check(edge + 1));
+}
+
+// a shift of 63 keeps the old top's bit, a shift of 64 or more clears the map
+static void test_shift_of_window_size_or_more()
+{
+  ReplayWindow w;
+  w.reset(1000);
+  w.mark(1000 + ReplayWindow::SIZE - 1);
+  TEST_ASSERT_FALSE(w.check(1000));
+  TEST_ASSERT_TRUE(w.check(1001));
+
+  w.reset(1000);
+  w.mark(1000 + ReplayWindow::SIZE);
+  TEST_ASSERT_FALSE(w.check(1000));
+  for (uint32_t s = 1001; s < 1000 + ReplayWindow::SIZE; s++)
+    TEST_ASSERT_TRUE(w.check(s));
+  TEST_ASSERT_FALSE(w.check(1000 + ReplayWindow::SIZE));
+
+  w.reset(1000);
+  w.mark(1000 + 100000);
+  TEST_ASSERT_TRUE(w.check(1000 + 100000 - 1));
+  TEST_ASSERT_TRUE(w.check(1000 + 100000 - (ReplayWindow::SIZE - 1)));
+  TEST_ASSERT_FALSE(w.check(1000 + 100000 - ReplayWindow::SIZE));
+  TEST_ASSERT_FALSE(w.check(1000 + 100000));
+}
+
+// marking a seq that is too old must not touch the bitmap
+static void test_mark_older_than_window_is_ignored()
+{
+  ReplayWindow w;
+  w.reset(1000);
+  w.mark(1100);
+  w.mark(1000);
+  for (uint32_t s = 1100 - (ReplayWindow::SIZE - 1); s < 1100; s++)
+    TEST_ASSERT_TRUE(w.check(s));
+  TEST_ASSERT_EQUAL_UINT32(1100, w.top());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_reset_marks_everything_below_top_seen);
+  RUN_TEST(test_out_of_order_inside_window);
+  RUN_TEST(test_duplicate_at_window_edge);
+  RUN_TEST(test_shift_of_window_size_or_more);
+  RUN_TEST(test_mark_older_than_window_is_ignored);
+  return UNITY_END();
+}
@@ -0,0 +1,104 @@
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+
+#include "SnapshotBuffer.h"
+
+void setUp() {}
+void tearDown() {}
+
+// every field derives from n, so a torn copy shows up as a mismatch
+struct Sample
+{
+  uint32_t n;
+  uint32_t inv;
+  uint32_t sq;
+  uint8_t pad[4096]; // big enough that a copy gets overtaken
+};
+
+static Sample makeSample(uint32_t n)
+{
+  Sample s;
+  s.n = n;
+  s.inv = ~n;
+  s.sq = n * n;
+  for (uint16_t i = 0; i < sizeof(s.pad); i++)
+    s.pad[i] = (uint8_t)(n + i);
+  return s;
+}
+
+static bool consistent(const Sample &s)
+{
+  if (s.inv != ~s.n || s.sq != s.n * s.n)
+    return false;
+  for (uint16_t i = 0; i < sizeof(s.pad); i++)
+    if (s.pad[i] != (uint8_t)(s.n + i))
+      return false;
+  return true;
+}
+
+static void test_read_before_first_write()
+{
+  SnapshotBuffer<Sample> buf;
+  Sample out = makeSample(5);
+  TEST_ASSERT_FALSE(buf.read(out));
+}
+
+static void test_read_returns_latest()
+{
+  SnapshotBuffer<Sample> buf;
+  Sample out;
+  buf.write(makeSample(1));
+  TEST_ASSERT_TRUE(buf.read(out));
+  TEST_ASSERT_EQUAL_UINT32(1, out.n);
+
+  // two writes between reads: the second reuses the slot the first read came from
+  buf.write(makeSample(2));
+  buf.write(makeSample(3));
+  TEST_ASSERT_TRUE(buf.read(out));
+  TEST_ASSERT_EQUAL_UINT32(3, out.n);
+  TEST_ASSERT_TRUE(consistent(out));
+}
+
+// writer flat out on another thread, so readers are regularly lapped mid-copy
+static void test_lapped_reader_never_sees_torn_value()
+{
+  SnapshotBuffer<Sample> buf;
+  std::atomic<bool> stop{false};
+  buf.write(makeSample(0));
+
+  std::thread writer([&]()
+                     {
+    for (uint32_t n = 1; !stop.load(std::memory_order_relaxed); n++)
+      buf.write(makeSample(n)); });
+
+  uint32_t torn = 0;
+  uint32_t last = 0;
+  bool monotonic = true;
+  Sample out;
+  for (uint32_t i = 0; i < 20000; i++)
+  {
+    if (!buf.read(out))
+      continue;
+    if (!consistent(out))
+      torn++;
+    if (out.n < last)
+      monotonic = false;
+    last = out.n;
+  }
+  stop = true;
+  writer.join();
+
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_TRUE(monotonic);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_read_before_first_write);
+  RUN_TEST(test_read_returns_latest);
+  RUN_TEST(test_lapped_reader_never_sees_torn_value);
+  return UNITY_END();
+}
@@ -0,0 +1,83 @@
+#include <unity.h>
+
+#include "SpscRing.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_empty_ring_pops_nothing()
+{
+  SpscRing<uint32_t, 4> ring;
+  uint32_t v = 0;
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_FALSE(ring.pop(v));
+  TEST_ASSERT_EQUAL_UINT32(0, ring.dropped());
+}
+
+static void test_full_ring_drops_and_keeps_order()
+{
+  SpscRing<uint32_t, 4> ring;
+  for (uint32_t i = 0; i < 4; i++)
+    TEST_ASSERT_TRUE(ring.push(i));
+
+  TEST_ASSERT_FALSE(ring.push(99u));
+  TEST_ASSERT_NULL(ring.beginPush());
+  TEST_ASSERT_EQUAL_UINT32(2, ring.dropped());
+
+  uint32_t v = 0;
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL_UINT32(i, v);
+  }
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_FALSE(ring.pop(v));
+}
+
+static void test_in_place_push()
+{
+  SpscRing<uint32_t, 2> ring;
+  uint32_t *slot = ring.beginPush();
+  TEST_ASSERT_NOT_NULL(slot);
+  *slot = 7;
+  TEST_ASSERT_TRUE(ring.empty()); // not visible before commitPush()
+  ring.commitPush();
+
+  uint32_t v = 0;
+  TEST_ASSERT_TRUE(ring.pop(v));
+  TEST_ASSERT_EQUAL_UINT32(7, v);
+}
+
+// head/tail are uint16_t: run them past 65535 and check full/empty still hold
+static void test_index_wraparound()
+{
+  SpscRing<uint32_t, 4> ring;
+  uint32_t v = 0;
+  for (uint32_t i = 0; i < 70000; i++)
+  {
+    TEST_ASSERT_TRUE(ring.push(i));
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL_UINT32(i, v);
+  }
+
+  for (uint32_t i = 0; i < 4; i++)
+    TEST_ASSERT_TRUE(ring.push(i));
+  TEST_ASSERT_FALSE(ring.push(4u));
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL_UINT32(i, v);
+  }
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_EQUAL_UINT32(1, ring.dropped());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_ring_pops_nothing);
+  RUN_TEST(test_full_ring_drops_and_keeps_order);
+  RUN_TEST(test_in_place_push);
+  RUN_TEST(test_index_wraparound);
+  return UNITY_END();
+}
@@ -0,0 +1,80 @@
+#include <unity.h>
+
+#include "TokenBucket.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void drain(TokenBucket &b, uint32_t now, uint16_t n)
+{
+  for (uint16_t i = 0; i < n; i++)
+    TEST_ASSERT_TRUE(b.take(now));
+  TEST_ASSERT_FALSE(b.take(now));
+}
+
+static void test_burst_then_empty()
+{
+  TokenBucket b;
+  b.configure(3, 100, 0);
+  TEST_ASSERT_EQUAL_UINT32(3000, b.milliTokens());
+  TEST_ASSERT_EQUAL_UINT32(0, b.msUntilToken());
+  drain(b, 0, 3);
+  TEST_ASSERT_EQUAL_UINT32(0, b.milliTokens());
+  TEST_ASSERT_EQUAL_UINT32(100, b.msUntilToken());
+}
+
+static void test_refill_one_token_per_interval()
+{
+  TokenBucket b;
+  b.configure(3, 100, 0);
+  drain(b, 0, 3);
+  TEST_ASSERT_FALSE(b.take(99));
+  TEST_ASSERT_EQUAL_UINT32(1, b.msUntilToken());
+  TEST_ASSERT_TRUE(b.take(100));
+  TEST_ASSERT_FALSE(b.take(100));
+  TEST_ASSERT_TRUE(b.take(250));
+  TEST_ASSERT_EQUAL_UINT32(500, b.milliTokens());
+}
+
+// a long idle fills the bucket to burst, never past it
+static void test_refill_after_long_idle_caps_at_burst()
+{
+  TokenBucket b;
+  b.configure(3, 100, 0);
+  drain(b, 0, 3);
+  drain(b, 1000000, 3);
+
+  // elapsed of almost 2^32 ms must not overflow the level
+  drain(b, 1000000 - 1, 3);
+}
+
+// millis() wraps after ~49.7 days; elapsed is still nowMs - lastMs
+static void test_refill_across_millis_wrap()
+{
+  TokenBucket b;
+  b.configure(3, 100, 0xFFFFFFF0u);
+  drain(b, 0xFFFFFFF0u, 3);
+  TEST_ASSERT_TRUE(b.take(0x00000054u)); // 0x64 = 100 ms later
+  TEST_ASSERT_FALSE(b.take(0x00000054u));
+  drain(b, 0x00100000u, 3);
+}
+
+static void test_no_refill_is_a_hard_cap()
+{
+  TokenBucket b;
+  b.configure(2, 0, 0);
+  drain(b, 0, 2);
+  TEST_ASSERT_FALSE(b.take(1000000));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, b.msUntilToken());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_then_empty);
+  RUN_TEST(test_refill_one_token_per_interval);
+  RUN_TEST(test_refill_after_long_idle_caps_at_burst);
+  RUN_TEST(test_refill_across_millis_wrap);
+  RUN_TEST(test_no_refill_is_a_hard_cap);
+  return UNITY_END();
+}